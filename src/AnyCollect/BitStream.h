@@ -0,0 +1,215 @@
+//
+// BitStream.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+
+namespace AnyCollect {
+	/**
+	 * @brief Class used to write bits, most significant first, and LEB128 variable-length integers to a byte buffer
+	 */
+	class BitWriter {
+		protected:
+			std::vector<uint8_t>& buffer_;		//!< Buffer bits are appended to
+			unsigned bitCount_;					//!< Number of bits used in the last byte of the buffer (0 if it is full)
+
+		public:
+			/**
+			 * @brief Construct a new BitWriter object appending to a buffer
+			 */
+			BitWriter(std::vector<uint8_t>& buffer) noexcept :
+				buffer_(buffer),
+				bitCount_(0)
+			{ }
+
+
+			/**
+			 * @brief Writes the lowest bits of a value
+			 *
+			 * @param value the bits to write
+			 * @param count number of bits to write (at most 64)
+			 */
+			void writeBits(uint64_t value, unsigned count) {
+				while (count > 0) {
+					if (this->bitCount_ == 0)
+						this->buffer_.push_back(0);
+					unsigned available = 8 - this->bitCount_;
+					unsigned written = (count < available) ? count : available;
+					uint8_t bits = static_cast<uint8_t>((value >> (count - written)) & ((1u << written) - 1));
+					this->buffer_.back() |= static_cast<uint8_t>(bits << (available - written));
+					this->bitCount_ = (this->bitCount_ + written) & 7;
+					count -= written;
+				}
+			}
+
+			/**
+			 * @brief Writes a single bit
+			 */
+			void writeBit(bool bit) {
+				this->writeBits(bit ? 1 : 0, 1);
+			}
+
+			/**
+			 * @brief Pads the last byte with zeros, so that the next write starts on a byte boundary
+			 */
+			void align() noexcept {
+				this->bitCount_ = 0;
+			}
+
+			/**
+			 * @brief Writes a variable-length unsigned integer, on a byte boundary
+			 */
+			void writeVarint(uint64_t value) {
+				this->align();
+				while (value >= 0x80) {
+					this->buffer_.push_back(static_cast<uint8_t>(value | 0x80));
+					value >>= 7;
+				}
+				this->buffer_.push_back(static_cast<uint8_t>(value));
+			}
+
+			/**
+			 * @brief Writes a length-prefixed string, on a byte boundary
+			 */
+			void writeString(std::string_view str) {
+				this->writeVarint(str.size());
+				this->buffer_.insert(this->buffer_.end(), str.begin(), str.end());
+			}
+	};
+
+
+	/**
+	 * @brief Class used to read data written by `BitWriter`
+	 *
+	 * Reading past the end of the data returns zeros and sets the overflow flag, so that corrupted data cannot read out of bounds.
+	 */
+	class BitReader {
+		protected:
+			const uint8_t* data_;				//!< Data to read
+			size_t size_;						//!< Size of the data in bytes
+			size_t position_;					//!< Position of the next bit to read
+			bool hasOverflowed_;				//!< Whether a read went past the end of the data
+
+		public:
+			/**
+			 * @brief Construct a new BitReader object
+			 */
+			BitReader(const uint8_t* data, size_t size) noexcept :
+				data_(data),
+				size_(size),
+				position_(0),
+				hasOverflowed_(false)
+			{ }
+
+
+			/**
+			 * @brief Returns whether a read went past the end of the data
+			 */
+			bool hasOverflowed() const noexcept {
+				return this->hasOverflowed_;
+			}
+
+			/**
+			 * @brief Sets the overflow flag, when decoded data is found inconsistent
+			 */
+			void setOverflowed() noexcept {
+				this->hasOverflowed_ = true;
+			}
+
+			/**
+			 * @brief Returns the position of the next byte to read, once aligned
+			 */
+			size_t bytePosition() const noexcept {
+				return (this->position_ + 7) / 8;
+			}
+
+			/**
+			 * @brief Reads bits, most significant first
+			 *
+			 * @param count number of bits to read (at most 64)
+			 */
+			uint64_t readBits(unsigned count) noexcept {
+				uint64_t value = 0;
+				while (count > 0) {
+					size_t byte = this->position_ / 8;
+					if (byte >= this->size_) {
+						this->hasOverflowed_ = true;
+						return 0;
+					}
+					unsigned offset = this->position_ & 7;
+					unsigned available = 8 - offset;
+					unsigned read = (count < available) ? count : available;
+					uint8_t bits = static_cast<uint8_t>(this->data_[byte] >> (available - read)) & static_cast<uint8_t>((1u << read) - 1);
+					value = (value << read) | bits;
+					this->position_ += read;
+					count -= read;
+				}
+				return value;
+			}
+
+			/**
+			 * @brief Reads a single bit
+			 */
+			bool readBit() noexcept {
+				return this->readBits(1) != 0;
+			}
+
+			/**
+			 * @brief Skips the remaining bits of the current byte
+			 */
+			void align() noexcept {
+				this->position_ = this->bytePosition() * 8;
+			}
+
+			/**
+			 * @brief Reads a variable-length unsigned integer, on a byte boundary
+			 */
+			uint64_t readVarint() noexcept {
+				this->align();
+				uint64_t value = 0;
+				for (unsigned shift = 0; shift < 64; shift += 7) {
+					uint64_t byte = this->readBits(8);
+					value |= (byte & 0x7f) << shift;
+					if ((byte & 0x80) == 0 || this->hasOverflowed_)
+						break;
+				}
+				return value;
+			}
+
+			/**
+			 * @brief Reads a length-prefixed string, on a byte boundary
+			 */
+			std::string_view readString() noexcept {
+				size_t size = this->readVarint();
+				size_t byte = this->bytePosition();
+				if (size > this->size_ - byte) {
+					this->hasOverflowed_ = true;
+					return {};
+				}
+				this->position_ += size * 8;
+				return std::string_view{reinterpret_cast<const char*>(this->data_ + byte), size};
+			}
+	};
+}
@@ -0,0 +1,146 @@
+//
+// BoundedQueue.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+
+namespace AnyCollect {
+	/**
+	 * @brief Bounded lock-free queue, safe for any number of producers and consumers
+	 *
+	 * Each slot holds a sequence number telling whether it is ready to be written or read at a given position, so that pushing and popping only take a compare-and-swap on the queue position (see D. Vyukov's bounded MPMC queue). The capacity is rounded up to a power of two, and to at least 2: with a single slot, a full slot would look writable to the next push.
+	 *
+	 * @tparam T type of the queued values, which must be default-constructible and movable
+	 */
+	template<typename T>
+	class BoundedQueue {
+		protected:
+			/**
+			 * @brief Slot of the queue
+			 */
+			struct Slot {
+				std::atomic<size_t> sequence;						//!< Position at which the slot can be written (equal) or read (one more)
+				T value;											//!< Value stored in the slot
+			};
+
+			size_t mask_;											//!< Capacity minus one, used to map positions to slots
+			std::unique_ptr<Slot[]> slots_;							//!< Slots of the queue
+			alignas(64) std::atomic<size_t> pushPosition_;			//!< Position of the next push
+			alignas(64) std::atomic<size_t> popPosition_;			//!< Position of the next pop
+
+		public:
+			/**
+			 * @brief Construct a new BoundedQueue object
+			 *
+			 * @param capacity minimum number of values the queue can hold
+			 */
+			BoundedQueue(size_t capacity) :
+				mask_(0),
+				pushPosition_(0),
+				popPosition_(0)
+			{
+				size_t size = 2;
+				while (size < capacity)
+					size <<= 1;
+				this->mask_ = size - 1;
+				this->slots_ = std::make_unique<Slot[]>(size);
+				for (size_t i = 0; i < size; i++)
+					this->slots_[i].sequence.store(i, std::memory_order_relaxed);
+			}
+
+			BoundedQueue(const BoundedQueue&) = delete;
+			BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+
+			/**
+			 * @brief Returns the number of values the queue can hold
+			 */
+			size_t capacity() const noexcept {
+				return this->mask_ + 1;
+			}
+
+			/**
+			 * @brief Returns the number of values in the queue (approximate while other threads use it)
+			 */
+			size_t size() const noexcept {
+				size_t popPosition = this->popPosition_.load(std::memory_order_acquire);
+				size_t pushPosition = this->pushPosition_.load(std::memory_order_acquire);
+				return (pushPosition > popPosition) ? std::min(pushPosition - popPosition, this->capacity()) : 0;
+			}
+
+
+			/**
+			 * @brief Pushes a value, unless the queue is full
+			 *
+			 * @param value the value, moved from only if it was pushed
+			 * @return *true* if the value was pushed
+			 * @return *false* if the queue is full
+			 */
+			bool tryPush(T& value) noexcept {
+				size_t position = this->pushPosition_.load(std::memory_order_relaxed);
+				while (true) {
+					Slot& slot = this->slots_[position & this->mask_];
+					auto difference = static_cast<intptr_t>(slot.sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(position);
+					if (difference == 0) {
+						if (this->pushPosition_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+							slot.value = std::move(value);
+							slot.sequence.store(position + 1, std::memory_order_release);
+							return true;
+						}
+					} else if (difference < 0)
+						return false;
+					else
+						position = this->pushPosition_.load(std::memory_order_relaxed);
+				}
+			}
+
+			/**
+			 * @brief Pops the oldest value, unless the queue is empty
+			 *
+			 * @param value set to the popped value
+			 * @return *true* if a value was popped
+			 * @return *false* if the queue is empty
+			 */
+			bool tryPop(T& value) noexcept {
+				size_t position = this->popPosition_.load(std::memory_order_relaxed);
+				while (true) {
+					Slot& slot = this->slots_[position & this->mask_];
+					auto difference = static_cast<intptr_t>(slot.sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(position + 1);
+					if (difference == 0) {
+						if (this->popPosition_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+							value = std::move(slot.value);
+							slot.sequence.store(position + this->mask_ + 1, std::memory_order_release);
+							return true;
+						}
+					} else if (difference < 0)
+						return false;
+					else
+						position = this->popPosition_.load(std::memory_order_relaxed);
+				}
+			}
+	};
+}
@@ -18,31 +18,53 @@
 // limitations under the License.
 //
 
+#include <tuple>
+
 #include "Config.h"
 #include "Source.h"
 
 
 namespace AnyCollect {
 	Config::Config(const std::string& path) noexcept {
+		Source configFile = Source{path};
+		configFile.update();
+		this->parse(configFile.contents());
+	}
+
+	void Config::parse(std::string_view contents) noexcept {
+		this->contentsHash = Hasher::hash(contents);
 		try {
-			Source configFile = Source{path};
-			configFile.update();
-			if (configFile.contents().empty())
+			if (contents.empty()) {
+				this->isEmpty = true;
 				return;
+			}
 
-			nlohmann::json configJson = nlohmann::json::parse(configFile.contents());
+			nlohmann::json configJson = nlohmann::json::parse(contents);
 			from_json(configJson, *this);
 		}
 		catch(const std::exception& e) {
 			std::cerr << "Error while parsing configuration file: invalid JSON contents." <<std::endl;
 			std::cerr << "Internal error: " << e.what() << std::endl;
-			abort();
+			this->files.clear();
+			this->commands.clear();
+			this->isValid = false;
 		}
 	}
 
 
-	void from_json(const nlohmann::json& je, Config::expression& e) noexcept {
+	bool operator==(const Config::expression::metric& lhs, const Config::expression::metric& rhs) noexcept {
+		return std::tie(lhs.name, lhs.value, lhs.unit, lhs.tags, lhs.computeRate, lhs.convertToUnitsPerSecond, lhs.maxSeries, lhs.overflowPolicy, lhs.counterType, lhs.emission, lhs.deadband, lhs.relativeDeadband, lhs.heartbeat)
+			== std::tie(rhs.name, rhs.value, rhs.unit, rhs.tags, rhs.computeRate, rhs.convertToUnitsPerSecond, rhs.maxSeries, rhs.overflowPolicy, rhs.counterType, rhs.emission, rhs.deadband, rhs.relativeDeadband, rhs.heartbeat);
+	}
+
+	bool operator==(const Config::expression& lhs, const Config::expression& rhs) noexcept {
+		return lhs.regex == rhs.regex && lhs.maxSeries == rhs.maxSeries && lhs.metrics == rhs.metrics;
+	}
+
+
+	void from_json(const nlohmann::json& je, Config::expression& e) {
 		e.regex = getValue<Config::expression::regexType>(je, Config::expression::regexKey);
+		e.maxSeries = getOptionalValue<Config::expression::maxSeriesType>(je, Config::expression::maxSeriesKey, 0);
 		for (const auto& jem : getValue<Config::expression::metricsType>(je, Config::expression::metricsKey)) {
 			Config::expression::metric m;
 			m.name = getValue<Config::expression::metric::nameType>(jem, Config::expression::metric::nameKey);
@@ -51,11 +73,18 @@ namespace AnyCollect {
 			m.tags = getValue<Config::expression::metric::tagsType>(jem, Config::expression::metric::tagsKey);
 			m.computeRate = getValue<Config::expression::metric::computeRateType>(jem, Config::expression::metric::computeRateKey);
 			m.convertToUnitsPerSecond = getValue<Config::expression::metric::convertToUnitsPerSecondType>(jem, Config::expression::metric::convertToUnitsPerSecondKey);
+			m.maxSeries = getOptionalValue<Config::expression::metric::maxSeriesType>(jem, Config::expression::metric::maxSeriesKey, 0);
+			m.overflowPolicy = getOptionalValue<Config::expression::metric::overflowPolicyType>(jem, Config::expression::metric::overflowPolicyKey, "");
+			m.counterType = getOptionalValue<Config::expression::metric::counterTypeType>(jem, Config::expression::metric::counterTypeKey, "");
+			m.emission = getOptionalValue<Config::expression::metric::emissionType>(jem, Config::expression::metric::emissionKey, "");
+			m.deadband = getOptionalValue<Config::expression::metric::deadbandType>(jem, Config::expression::metric::deadbandKey, 0);
+			m.relativeDeadband = getOptionalValue<Config::expression::metric::relativeDeadbandType>(jem, Config::expression::metric::relativeDeadbandKey, 0);
+			m.heartbeat = getOptionalValue<Config::expression::metric::heartbeatType>(jem, Config::expression::metric::heartbeatKey, 0);
 			e.metrics.push_back(std::move(m));
 		}
 	}
 
-	void from_json(const nlohmann::json& j, Config& c) noexcept {
+	void from_json(const nlohmann::json& j, Config& c) {
 		if (j.count(std::string(Config::filesKey)) > 0) {
 			for (const auto& jf : getValue<Config::filesType>(j, Config::filesKey)) {
 				Config::file f;
@@ -21,10 +21,13 @@
 #pragma once
 
 #include <iostream>
+#include <stdexcept>
 #include <string_view>
 
 #include <json.hpp>
 
+#include "Hash.h"
+
 using namespace std::literals;
 
 
@@ -47,6 +50,20 @@ namespace AnyCollect {
 				using computeRateType = bool;
 				static constexpr std::string_view convertToUnitsPerSecondKey = "ConvertToUnitsPerSecond"sv;
 				using convertToUnitsPerSecondType = bool;
+				static constexpr std::string_view maxSeriesKey = "MaxSeries"sv;
+				using maxSeriesType = size_t;
+				static constexpr std::string_view overflowPolicyKey = "OverflowPolicy"sv;
+				using overflowPolicyType = std::string;
+				static constexpr std::string_view counterTypeKey = "CounterType"sv;
+				using counterTypeType = std::string;
+				static constexpr std::string_view emissionKey = "Emission"sv;
+				using emissionType = std::string;
+				static constexpr std::string_view deadbandKey = "Deadband"sv;
+				using deadbandType = double;
+				static constexpr std::string_view relativeDeadbandKey = "RelativeDeadband"sv;
+				using relativeDeadbandType = double;
+				static constexpr std::string_view heartbeatKey = "Heartbeat"sv;
+				using heartbeatType = size_t;
 
 				nameType name;
 				valueType value;
@@ -54,14 +71,24 @@ namespace AnyCollect {
 				tagsType tags;
 				computeRateType computeRate;
 				convertToUnitsPerSecondType convertToUnitsPerSecond;
+				maxSeriesType maxSeries = 0;
+				overflowPolicyType overflowPolicy;
+				counterTypeType counterType;
+				emissionType emission;
+				deadbandType deadband = 0;
+				relativeDeadbandType relativeDeadband = 0;
+				heartbeatType heartbeat = 0;
 			};
 			static constexpr std::string_view regexKey = "Regex"sv;
 			using regexType = std::string;
 			static constexpr std::string_view metricsKey = "Metrics"sv;
 			using metricsType = std::vector<nlohmann::json>;
+			static constexpr std::string_view maxSeriesKey = "MaxSeries"sv;
+			using maxSeriesType = size_t;
 
 			regexType regex;
 			std::vector<Config::expression::metric> metrics;
+			maxSeriesType maxSeries = 0;
 		};
 
 		struct file {
@@ -94,6 +121,14 @@ namespace AnyCollect {
 
 		std::vector<Config::file> files;
 		std::vector<Config::command> commands;
+		bool isValid = true;		//!< Whether the config file could be parsed (errors are reported on the standard error)
+		bool isEmpty = false;		//!< Whether the config file was empty (e.g. truncated or caught while being written)
+		Key contentsHash{0, 0};		//!< Hash of the JSON contents the config was parsed from
+
+		/**
+		 * @brief Construct an empty Config object
+		 */
+		Config() noexcept = default;
 
 		/**
 		 * @brief Parses the specified config file into a Config object
@@ -101,21 +136,39 @@ namespace AnyCollect {
 		 * @param path path of the config file to parse
 		 */
 		Config(const std::string& path) noexcept;
+
+		/**
+		 * @brief Parses JSON contents into the receiver, which must be empty
+		 *
+		 * @param contents the JSON contents of a config file
+		 */
+		void parse(std::string_view contents) noexcept;
     };
 
 
+	/**
+	 * @brief Returns whether two metric templates are configured the same way
+	 */
+	bool operator==(const Config::expression::metric& lhs, const Config::expression::metric& rhs) noexcept;
+
+	/**
+	 * @brief Returns whether two expressions, along with their metric templates, are configured the same way
+	 */
+	bool operator==(const Config::expression& lhs, const Config::expression& rhs) noexcept;
+
+
 	/**
 	 * @brief Converts a json object into a Config object
 	 *
 	 * @param j json object to parse
 	 * @param c Config object to put json values into
 	 */
-	void from_json(const nlohmann::json& j, Config& c) noexcept;
+	void from_json(const nlohmann::json& j, Config& c);
 
 	/**
 	 * @brief Parse a JSON value of specified type from a JSON dictionary
 	 *
-	 * If the key is not in the JSON dictionary, the program's execution is aborted with an error.
+	 * If the key is not in the JSON dictionary, an error is reported and an exception thrown.
 	 *
 	 * @tparam T Expected type of JSON object
 	 * @tparam K Type of key
@@ -124,14 +177,32 @@ namespace AnyCollect {
 	 * @return the extracted value with specified key and type
 	 */
 	template<typename T, typename K>
-	T getValue(const nlohmann::json& j, const K& key) noexcept {
+	T getValue(const nlohmann::json& j, const K& key) {
 		try {
 			return j[std::string(key)].get<T>();
 		}
 		catch(const std::exception& e) {
 			std::cerr << "Error while parsing configuration file: field named \"" << key << "\" of required type not found." << std::endl;
-			std::cerr << "Internal error: " << e.what() << std::endl;
-			abort();
+			throw;
 		}
 	}
+
+	/**
+	 * @brief Parse an optional JSON value of specified type from a JSON dictionary
+	 *
+	 * If the key is not in the JSON dictionary, the default value is returned. If it is there but has the wrong type, an error is reported and an exception thrown.
+	 *
+	 * @tparam T Expected type of JSON object
+	 * @tparam K Type of key
+	 * @param j JSON dictionary
+	 * @param key key of the JSON object to get
+	 * @param defaultValue value returned if the key is not in the JSON dictionary
+	 * @return the extracted value with specified key and type, or the default value
+	 */
+	template<typename T, typename K>
+	T getOptionalValue(const nlohmann::json& j, const K& key, const T& defaultValue) {
+		if (j.count(std::string(key)) == 0)
+			return defaultValue;
+		return getValue<T>(j, key);
+	}
 }
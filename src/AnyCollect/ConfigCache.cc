@@ -0,0 +1,233 @@
+//
+// ConfigCache.cc
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ConfigCache.h"
+
+
+namespace AnyCollect {
+	namespace {
+		void writeDouble(BitWriter& writer, double value) {
+			uint64_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			writer.writeBits(bits, 64);
+		}
+
+		double readDouble(BitReader& reader) noexcept {
+			reader.align();
+			uint64_t bits = reader.readBits(64);
+			double value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		void writeStrings(BitWriter& writer, const std::vector<std::string>& strings) {
+			writer.writeVarint(strings.size());
+			for (const auto& str : strings)
+				writer.writeString(str);
+		}
+
+		// Each element takes at least one byte, which bounds counts read from corrupted data
+		size_t readCount(BitReader& reader, size_t size) noexcept {
+			size_t count = reader.readVarint();
+			if (count > size - std::min(reader.bytePosition(), size)) {
+				reader.setOverflowed();
+				return 0;
+			}
+			return count;
+		}
+
+		std::vector<std::string> readStrings(BitReader& reader, size_t size) {
+			std::vector<std::string> strings(readCount(reader, size));
+			for (auto& str : strings)
+				str = reader.readString();
+			return strings;
+		}
+	}
+
+
+	void ConfigCache::encodeExpression(BitWriter& writer, const Config::expression& expression) {
+		writer.writeString(expression.regex);
+		writer.writeVarint(expression.maxSeries);
+		writer.writeVarint(expression.metrics.size());
+		for (const auto& metric : expression.metrics) {
+			writeStrings(writer, metric.name);
+			writer.writeString(metric.value);
+			writer.writeString(metric.unit);
+			writer.writeVarint(metric.tags.size());
+			for (const auto& [key, value] : metric.tags) {
+				writer.writeString(key);
+				writer.writeString(value);
+			}
+			writer.writeVarint(metric.computeRate);
+			writer.writeVarint(metric.convertToUnitsPerSecond);
+			writer.writeVarint(metric.maxSeries);
+			writer.writeString(metric.overflowPolicy);
+			writer.writeString(metric.counterType);
+			writer.writeString(metric.emission);
+			writer.align();
+			writeDouble(writer, metric.deadband);
+			writeDouble(writer, metric.relativeDeadband);
+			writer.writeVarint(metric.heartbeat);
+		}
+	}
+
+	Config::expression ConfigCache::decodeExpression(BitReader& reader, size_t size) {
+		Config::expression expression;
+		expression.regex = reader.readString();
+		expression.maxSeries = reader.readVarint();
+		expression.metrics.resize(readCount(reader, size));
+		for (auto& metric : expression.metrics) {
+			metric.name = readStrings(reader, size);
+			metric.value = reader.readString();
+			metric.unit = reader.readString();
+			size_t tagCount = readCount(reader, size);
+			for (size_t i = 0; i < tagCount && !reader.hasOverflowed(); i++) {
+				std::string key{reader.readString()};
+				metric.tags.emplace(std::move(key), reader.readString());
+			}
+			metric.computeRate = reader.readVarint() != 0;
+			metric.convertToUnitsPerSecond = reader.readVarint() != 0;
+			metric.maxSeries = reader.readVarint();
+			metric.overflowPolicy = reader.readString();
+			metric.counterType = reader.readString();
+			metric.emission = reader.readString();
+			metric.deadband = readDouble(reader);
+			metric.relativeDeadband = readDouble(reader);
+			metric.heartbeat = reader.readVarint();
+		}
+		return expression;
+	}
+
+	void ConfigCache::encodeConfig(BitWriter& writer, const Config& config) {
+		writer.writeVarint(config.files.size());
+		for (const auto& file : config.files) {
+			writeStrings(writer, file.paths);
+			writer.writeVarint(file.expressions.size());
+			for (const auto& expression : file.expressions)
+				ConfigCache::encodeExpression(writer, expression);
+		}
+		writer.writeVarint(config.commands.size());
+		for (const auto& command : config.commands) {
+			writer.writeString(command.program);
+			writeStrings(writer, command.arguments);
+			writer.writeVarint(command.expressions.size());
+			for (const auto& expression : command.expressions)
+				ConfigCache::encodeExpression(writer, expression);
+		}
+	}
+
+	std::unique_ptr<Config> ConfigCache::decodeConfig(const uint8_t* data, size_t size) {
+		BitReader reader{data, size};
+		auto config = std::make_unique<Config>();
+		config->files.resize(readCount(reader, size));
+		for (auto& file : config->files) {
+			file.paths = readStrings(reader, size);
+			file.expressions.resize(readCount(reader, size));
+			for (auto& expression : file.expressions)
+				expression = ConfigCache::decodeExpression(reader, size);
+		}
+		config->commands.resize(readCount(reader, size));
+		for (auto& command : config->commands) {
+			command.program = reader.readString();
+			command.arguments = readStrings(reader, size);
+			command.expressions.resize(readCount(reader, size));
+			for (auto& expression : command.expressions)
+				expression = ConfigCache::decodeExpression(reader, size);
+		}
+		if (reader.hasOverflowed() || reader.bytePosition() != size)
+			return nullptr;
+		return config;
+	}
+
+
+	std::unique_ptr<Config> ConfigCache::load(const std::string& cachePath, const Key& configHash) noexcept {
+		int fd = ::open(cachePath.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return nullptr;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+			::close(fd);
+			return nullptr;
+		}
+		size_t size = st.st_size;
+		void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED)
+			return nullptr;
+
+		std::unique_ptr<Config> config;
+		Header header;
+		std::memcpy(&header, data, sizeof(Header));
+		const uint8_t* configData = static_cast<const uint8_t*>(data) + sizeof(Header);
+		if (header.magic == ConfigCache::magic && header.version == ConfigCache::version && header.configHash == configHash && header.size == size - sizeof(Header)
+			&& header.dataHash == Hasher::hash(std::string_view{reinterpret_cast<const char*>(configData), header.size})) {
+			try {
+				config = ConfigCache::decodeConfig(configData, header.size);
+				if (config != nullptr)
+					config->contentsHash = configHash;
+			}
+			catch (const std::exception& e) {
+				config = nullptr;
+			}
+		}
+		munmap(data, size);
+		return config;
+	}
+
+	bool ConfigCache::store(const std::string& cachePath, const Key& configHash, const Config& config) noexcept {
+		try {
+			std::vector<uint8_t> buffer(sizeof(Header));
+			BitWriter writer{buffer};
+			ConfigCache::encodeConfig(writer, config);
+			size_t dataSize = buffer.size() - sizeof(Header);
+			Key dataHash = Hasher::hash(std::string_view{reinterpret_cast<const char*>(buffer.data() + sizeof(Header)), dataSize});
+			Header header{ConfigCache::magic, ConfigCache::version, configHash, dataSize, dataHash};
+			std::memcpy(buffer.data(), &header, sizeof(Header));
+
+			// Write a temporary file and rename it, so that readers never see a partial cache
+			std::string temporaryPath = cachePath + ".tmp";
+			FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+			if (file == nullptr) {
+				perror(std::string(temporaryPath).append(": Error creating config cache").c_str());
+				return false;
+			}
+			bool isWritten = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+			isWritten &= (std::fclose(file) == 0);
+			if (!isWritten || std::rename(temporaryPath.c_str(), cachePath.c_str()) != 0) {
+				perror(std::string(cachePath).append(": Error writing config cache").c_str());
+				std::remove(temporaryPath.c_str());
+				return false;
+			}
+			return true;
+		}
+		catch (const std::exception& e) {
+			std::cerr << cachePath << ": Error writing config cache: " << e.what() << std::endl;
+			return false;
+		}
+	}
+}
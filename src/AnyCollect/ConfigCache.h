@@ -0,0 +1,98 @@
+//
+// ConfigCache.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "BitStream.h"
+#include "Config.h"
+#include "Hash.h"
+
+
+namespace AnyCollect {
+	/**
+	 * @brief Class used to store parsed configs in a binary file, so that a config does not need to be parsed again until it changes
+	 *
+	 * The file starts with a header holding the hash of the JSON contents it was parsed from, and the version of the format. A file whose hash or version differs is ignored, so that the config is parsed again and the file replaced. Compiled regexes cannot be stored: they are still compiled from their pattern.
+	 */
+	class ConfigCache {
+		public:
+			static constexpr uint64_t magic = 0x31304746434e4341;						//!< Magic number of cache files ("ACNCFG01")
+			static constexpr uint64_t version = 1;										//!< Version of the cache format, to be incremented whenever `Config` changes
+
+		protected:
+			/**
+			 * @brief Header at the beginning of a cache file
+			 */
+			struct Header {
+				uint64_t magic;															//!< Magic number (`ConfigCache::magic`)
+				uint64_t version;														//!< Version of the format (`ConfigCache::version`)
+				Key configHash;															//!< Hash of the JSON contents the config was parsed from
+				uint64_t size;															//!< Number of bytes of encoded config after the header
+				Key dataHash;															//!< Hash of the encoded config, to detect corrupted files
+			};
+
+			/**
+			 * @brief Encodes an expression and its metric templates
+			 */
+			static void encodeExpression(BitWriter& writer, const Config::expression& expression);
+
+			/**
+			 * @brief Decodes an expression and its metric templates
+			 */
+			static Config::expression decodeExpression(BitReader& reader, size_t size);
+
+			/**
+			 * @brief Encodes a config
+			 */
+			static void encodeConfig(BitWriter& writer, const Config& config);
+
+			/**
+			 * @brief Decodes a config
+			 *
+			 * @return the config, or null if the data is corrupted
+			 */
+			static std::unique_ptr<Config> decodeConfig(const uint8_t* data, size_t size);
+
+		public:
+			/**
+			 * @brief Loads a config from a cache file, if it was parsed from the given contents
+			 *
+			 * @param cachePath path of the cache file
+			 * @param configHash hash of the JSON contents of the config
+			 * @return the config, or null if the file does not exist, is stale or is corrupted
+			 */
+			static std::unique_ptr<Config> load(const std::string& cachePath, const Key& configHash) noexcept;
+
+			/**
+			 * @brief Stores a config into a cache file, replacing it atomically
+			 *
+			 * @param cachePath path of the cache file
+			 * @param configHash hash of the JSON contents of the config
+			 * @param config the parsed config
+			 * @return *true* if the config was stored
+			 * @return *false* otherwise
+			 */
+			static bool store(const std::string& cachePath, const Key& configHash, const Config& config) noexcept;
+	};
+}
@@ -18,7 +18,13 @@
 // limitations under the License.
 //
 
+#include <algorithm>
+#include <atomic>
+#include <iostream>
 #include <thread>
+#include <unordered_map>
+
+#include <boost/filesystem.hpp>
 
 #if GPERFTOOLS_CPU_PROFILE
 #include <gperftools/profiler.h>
@@ -27,15 +33,77 @@
 #include "Config.h"
 #include "Controller.h"
 
+namespace fs = boost::filesystem;
 
 namespace AnyCollect {
+	namespace {
+		// Name pattern of a matcher, used to tag the metrics describing it
+		std::string namePattern(const Matcher& matcher) {
+			std::string pattern;
+			for (const auto& part : matcher.name())
+				pattern.append(pattern.empty() ? "" : "/").append(part);
+			return pattern;
+		}
+
+		// Whether a matcher's metric names fall under the name prefix reserved for the controller's own metrics
+		bool hasReservedName(const Matcher& matcher) noexcept {
+			return !matcher.name().empty() && matcher.name().front() == Controller::internalMetricPrefix;
+		}
+
+		// Whether a parsed config can replace the current one, reporting why it cannot (an empty file only replaces nothing, since a reloaded file may be truncated or caught while being written)
+		bool isAcceptedConfig(const Config& config, const std::string& configPath, bool isReload) {
+			if (!config.isValid)
+				std::cerr << configPath << ": Invalid config file, keeping the current configuration." << std::endl;
+			else if (isReload && config.isEmpty)
+				std::cerr << configPath << ": Empty config file, keeping the current configuration." << std::endl;
+			else
+				return true;
+			return false;
+		}
+	}
+
+
 	Controller::Controller(ControllerDelegate& delegate) noexcept :
 		delegate_(delegate),
-		isCollecting_(false)
+		isCollecting_(false),
+		isStopRequested_(false),
+		missedRoundCount_(0),
+		roundKey_(1),
+		roundCount_(0),
+		runRoundKey_(0),
+		sourceRoundKey_(0),
+		verifiesKeys_(false),
+		keyCollisionCount_(0),
+		staleSeriesThreshold_(Controller::defaultStaleSeriesThreshold),
+		compactionInterval_(Controller::defaultCompactionInterval),
+		roundsSinceCompaction_(0),
+		evictedSeriesCount_(0),
+		maxCollectDuration_(Controller::defaultMaxCollectDuration),
+		firstSourceIndex_(0),
+		deferredSourceCount_(0),
+		maxSeries_(Controller::defaultMaxSeries),
+		matchedSeriesCount_(0),
+		rejectedSeriesCount_(0),
+		hasSeriesBudgets_(false),
+		configWriteTime_(0),
+		watchesConfigFile_(false),
+		configHash_{0, 0},
+		pendingConfigWriteTime_(0),
+		suppressedValueCount_(0),
+		isCounterCheckpointRestored_(false),
+		spoolReplayBatchSize_(Controller::defaultSpoolReplayBatchSize),
+		publishesSnapshots_(false),
+		emitsSelfMetrics_(false),
+		measuresRound_(false)
 	{
 		this->setSamplingInterval(Controller::defaultSamplingInterval);
 	}
 
+	Controller::~Controller() {
+		this->stop();
+		this->join();
+	}
+
 
 	ControllerDelegate& Controller::delegate() const noexcept {
 		return this->delegate_;
@@ -46,174 +114,1125 @@ namespace AnyCollect {
 		return this->isCollecting_;
 	}
 
-	std::chrono::seconds Controller::samplingInterval() const noexcept {
+	std::chrono::milliseconds Controller::samplingInterval() const noexcept {
 		return this->samplingInterval_;
 	}
 
+	size_t Controller::missedRoundCount() const noexcept {
+		return this->missedRoundCount_;
+	}
 
-	void Controller::loadConfigFromFile(const std::string& configPath) {
-		if (this->isCollecting_)
+	size_t Controller::suppressedValueCount() const noexcept {
+		return this->suppressedValueCount_;
+	}
+
+	size_t Controller::counterResetCount(const Key& key) const noexcept {
+		auto index = this->metrics_.find(key);
+		return (index != MetricStore::npos) ? this->metrics_.resetCount(index) : 0;
+	}
+
+	bool Controller::verifiesKeys() const noexcept {
+		return this->verifiesKeys_;
+	}
+
+	size_t Controller::keyCollisionCount() const noexcept {
+		return this->keyCollisionCount_;
+	}
+
+	size_t Controller::staleSeriesThreshold() const noexcept {
+		return this->staleSeriesThreshold_;
+	}
+
+	size_t Controller::compactionInterval() const noexcept {
+		return this->compactionInterval_;
+	}
+
+	size_t Controller::seriesCount() const noexcept {
+		return this->metrics_.size();
+	}
+
+	size_t Controller::evictedSeriesCount() const noexcept {
+		return this->evictedSeriesCount_;
+	}
+
+	std::chrono::milliseconds Controller::maxCollectDuration() const noexcept {
+		return this->maxCollectDuration_;
+	}
+
+	size_t Controller::deferredSourceCount() const noexcept {
+		return this->deferredSourceCount_;
+	}
+
+	size_t Controller::maxSeries() const noexcept {
+		return this->maxSeries_;
+	}
+
+	size_t Controller::rejectedSeriesCount() const noexcept {
+		return this->rejectedSeriesCount_;
+	}
+
+	std::vector<SeriesHistory::Resolution> Controller::historyResolutions() const noexcept {
+		std::lock_guard<std::mutex> lock(this->storeMutex_);
+		return this->metrics_.history().resolutions();
+	}
+
+	std::vector<SeriesHistory::Point> Controller::history(const Key& key, std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to, std::chrono::seconds interval) const {
+		std::lock_guard<std::mutex> lock(this->storeMutex_);
+		auto index = this->metrics_.find(key);
+		if (index == MetricStore::npos)
+			return {};
+		return this->metrics_.history().query(index, from, to, interval);
+	}
+
+	size_t Controller::dispatchQueueSize() const noexcept {
+		return (this->dispatcher_ != nullptr) ? this->dispatcher_->capacity() : 0;
+	}
+
+	size_t Controller::dispatchQueueDepth() const noexcept {
+		return (this->dispatcher_ != nullptr) ? this->dispatcher_->queueDepth() : 0;
+	}
+
+	std::chrono::microseconds Controller::dispatchLatency() const noexcept {
+		return (this->dispatcher_ != nullptr) ? this->dispatcher_->lastDeliveryLatency() : 0us;
+	}
+
+	size_t Controller::overflowedDispatchCount() const noexcept {
+		return (this->dispatcher_ != nullptr) ? this->dispatcher_->droppedBatchCount() + this->dispatcher_->coalescedBatchCount() : 0;
+	}
+
+	bool Controller::watchesConfigFile() const noexcept {
+		return this->watchesConfigFile_;
+	}
+
+	const std::string& Controller::configCachePath() const noexcept {
+		return this->configCachePath_;
+	}
+
+	std::string Controller::counterCheckpointPath() const noexcept {
+		return (this->counterCheckpoint_ != nullptr) ? this->counterCheckpoint_->path() : std::string();
+	}
+
+	bool Controller::publishesSnapshots() const noexcept {
+		return this->publishesSnapshots_;
+	}
+
+	bool Controller::emitsSelfMetrics() const noexcept {
+		return this->emitsSelfMetrics_;
+	}
+
+	std::shared_ptr<const MetricSnapshot> Controller::snapshot() const noexcept {
+		return std::atomic_load(&this->snapshot_);
+	}
+
+	size_t Controller::spooledRoundCount() const noexcept {
+		return (this->spool_ != nullptr) ? this->spool_->pendingRoundCount() : 0;
+	}
+
+	size_t Controller::droppedSpooledRoundCount() const noexcept {
+		return (this->spool_ != nullptr) ? this->spool_->droppedRoundCount() : 0;
+	}
+
+
+	bool Controller::loadConfigFromFile(const std::string& configPath) {
+		// Take the modification time before reading, so that a change made while reading is reloaded
+		boost::system::error_code error;
+		auto writeTime = fs::last_write_time(configPath, error);
+		auto config = this->readConfigFile(configPath);
+
+		// While collecting, the controller state belongs to the collector thread (and a config was necessarily loaded): the config is only handed over
+		bool isCollecting = this->isCollecting_;
+		bool isReload = isCollecting || !this->configPath_.empty();
+		if (!isAcceptedConfig(*config, configPath, isReload)) {
+			if (!isReload)
+				abort();
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(this->configMutex_);
+			this->pendingConfig_ = std::move(config);
+			this->pendingConfigPath_ = configPath;
+			this->pendingConfigWriteTime_ = writeTime;
+		}
+		if (!isCollecting)
+			this->applyPendingConfig();
+		return true;
+	}
+
+	void Controller::setWatchesConfigFile(bool watchesConfigFile) noexcept {
+		this->watchesConfigFile_ = watchesConfigFile;
+	}
+
+	void Controller::setConfigCachePath(const std::string& cachePath) {
+		this->configCachePath_ = cachePath;
+	}
+
+	void Controller::setCounterCheckpointPath(const std::string& checkpointPath) {
+		if (this->isCollecting_ || checkpointPath == this->counterCheckpointPath())
 			return;
+		this->counterCheckpoint_ = checkpointPath.empty() ? nullptr : CounterCheckpoint::open(checkpointPath);
+		this->isCounterCheckpointRestored_ = false;
+		this->checkpointedSeries_.clear();
+		if (this->canCollect())
+			this->restoreCounterCheckpoint();
+	}
+
 
-		Config config = Config{configPath};
+	void Controller::applyPendingConfig() {
+		std::unique_ptr<Config> config;
+		std::string configPath;
+		std::time_t configWriteTime = 0;
+		std::optional<std::function<bool(const Matcher&)>> matcherFilter;
+		{
+			std::lock_guard<std::mutex> lock(this->configMutex_);
+			config = std::move(this->pendingConfig_);
+			configPath.swap(this->pendingConfigPath_);
+			configWriteTime = this->pendingConfigWriteTime_;
+			matcherFilter.swap(this->pendingMatcherFilter_);
+		}
+		if (matcherFilter.has_value())
+			this->matcherFilter_ = std::move(matcherFilter.value());
+		if (config != nullptr) {
+			this->configPath_ = std::move(configPath);
+			this->configWriteTime_ = configWriteTime;
+			this->applyConfig(*config);
+		}
+		else if (matcherFilter.has_value())
+			this->applyMatcherFilter();
+	}
+
+	void Controller::applyMatcherFilter() noexcept {
+		for (const auto& matcher : this->matchers_)
+			matcher->setEnabled(!hasReservedName(*matcher) && (!this->matcherFilter_ || this->matcherFilter_(*matcher)));
+		for (const auto& expression : this->expressions_) {
+			const auto& matchers = expression->matchers();
+			expression->setEnabled(std::any_of(matchers.begin(), matchers.end(), [](const auto& matcher) {
+				return matcher->isEnabled();
+			}));
+		}
+		for (const auto& source : this->sources_) {
+			const auto& expressions = source->expressions();
+			source->setEnabled(std::any_of(expressions.begin(), expressions.end(), [](const auto& expression) {
+				return expression->isEnabled();
+			}));
+		}
+	}
+
+	std::unique_ptr<Config> Controller::readConfigFile(const std::string& configPath) {
+		if (this->configCachePath_.empty())
+			return std::make_unique<Config>(configPath);
+
+		Source configFile{configPath};
+		configFile.update();
+		Key configHash = Hasher::hash(configFile.contents());
+		auto config = ConfigCache::load(this->configCachePath_, configHash);
+		if (config != nullptr)
+			return config;
+
+		config = std::make_unique<Config>();
+		config->parse(configFile.contents());
+		if (config->isValid && !config->isEmpty)
+			ConfigCache::store(this->configCachePath_, configHash, *config);
+		return config;
+	}
+
+	void Controller::reloadModifiedConfigFile() {
+		if (!this->watchesConfigFile_ || this->configPath_.empty())
+			return;
+		boost::system::error_code error;
+		auto writeTime = fs::last_write_time(this->configPath_, error);
+		if (error || writeTime == this->configWriteTime_)
+			return;
+
+		// Remember the time even if the file is invalid, so that it is only parsed again once modified
+		this->configWriteTime_ = writeTime;
+		auto config = this->readConfigFile(this->configPath_);
+		if (isAcceptedConfig(*config, this->configPath_, true))
+			this->applyConfig(*config);
+	}
+
+	void Controller::applyConfig(const Config& config) {
+		auto previousSources = std::move(this->sources_);
+		auto previousExpressions = std::move(this->expressions_);
+		auto previousExpressionConfigs = std::move(this->expressionConfigs_);
 		this->sources_.clear();
 		this->expressions_.clear();
+		this->expressionConfigs_.clear();
 		this->matchers_.clear();
-		size_t fileIndex = 0;
+		this->hasSeriesBudgets_ = false;
+		this->rejectedSeriesCount_ = 0;
+		this->rejectedKeys_.clear();
+
+		// Sources are identified by their normalized file path (without resolving links, since path parts may be substituted in metrics) or their command line, whose parts are length-prefixed so that arguments cannot run into each other
+		auto fileKey = [](const std::string& path) {
+			return "file " + fs::path(path).lexically_normal().string();
+		};
+		auto commandKey = [](const std::vector<std::string>& commandLine) {
+			std::string key = "command";
+			for (const auto& part : commandLine)
+				key.append(" ").append(std::to_string(part.size())).append(":").append(part);
+			return key;
+		};
+
+		// Index the previous objects, so that unchanged ones can be found quickly
+		std::unordered_map<std::string, std::shared_ptr<Source>> previousSourcesByKey;
+		for (auto& source : previousSources)
+			previousSourcesByKey.try_emplace(source->type() == Source::SourceTypeFile ? fileKey(source->path()) : commandKey(source->commandLine()), source);
+		std::unordered_map<std::string, std::shared_ptr<Source>> sourcesByKey;
+		std::unordered_multimap<std::string, size_t> expressionIndexesByRegex;
+		for (size_t i = 0; i < previousExpressionConfigs.size(); i++)
+			expressionIndexesByRegex.emplace(previousExpressionConfigs[i].regex, i);
+		std::vector<bool> isExpressionReused(previousExpressions.size(), false);
+		std::unordered_map<Matcher*, Matcher*> matcherReplacements;
+
+		// Each file or command is only read once per iteration, however many entries use it: their expressions are merged
+		auto makeSource = [&](const std::string& key, auto&& create) {
+			auto itr = sourcesByKey.find(key);
+			if (itr != sourcesByKey.end())
+				return itr->second;
+
+			std::shared_ptr<Source> source;
+			auto previousItr = previousSourcesByKey.find(key);
+			if (previousItr != previousSourcesByKey.end()) {
+				source = std::move(previousItr->second);
+				previousSourcesByKey.erase(previousItr);
+				source->expressions().clear();
+			} else
+				source = create();
+			sourcesByKey.emplace(key, source);
+			this->sources_.push_back(source);
+			return source;
+		};
+
+		auto makeExpression = [&](const Config::expression& expressionConfig) {
+			auto range = expressionIndexesByRegex.equal_range(expressionConfig.regex);
+			for (auto itr = range.first; itr != range.second; itr++) {
+				if (isExpressionReused[itr->second] || !(previousExpressionConfigs[itr->second] == expressionConfig))
+					continue;
+				isExpressionReused[itr->second] = true;
+				auto& expression = previousExpressions[itr->second];
+				for (const auto& matcher : expression->matchers()) {
+					this->matchers_.push_back(matcher);
+					matcherReplacements[matcher.get()] = matcher.get();
+				}
+				return expression;
+			}
+
+			std::shared_ptr<Expression> expression;
+			if (range.first != range.second)
+				expression = std::make_shared<Expression>(previousExpressions[range.first->second]->regex(), expressionConfig.maxSeries);
+			else
+				expression = std::make_shared<Expression>(expressionConfig.regex, expressionConfig.maxSeries);
+			for (const auto& metric : expressionConfig.metrics) {
+				auto matcher = std::make_shared<Matcher>(metric);
+				if (hasReservedName(*matcher))
+					std::cerr << namePattern(*matcher) << ": Metric names starting with \"" << Controller::internalMetricPrefix << "\" are reserved, ignoring the template." << std::endl;
+				matcher->setExpressionBudget(expression->budget());
+				expression->matchers().push_back(matcher);
+				this->matchers_.push_back(matcher);
+
+				// Series of a previous matcher configured the same way, on the same regex, are handed over
+				for (auto itr = range.first; itr != range.second; itr++) {
+					if (isExpressionReused[itr->second])
+						continue;
+					const auto& previousMetrics = previousExpressionConfigs[itr->second].metrics;
+					auto metricItr = std::find(previousMetrics.begin(), previousMetrics.end(), metric);
+					if (metricItr == previousMetrics.end())
+						continue;
+					auto previousMatcher = previousExpressions[itr->second]->matchers()[metricItr - previousMetrics.begin()].get();
+					if (matcherReplacements.try_emplace(previousMatcher, matcher.get()).second)
+						break;
+				}
+			}
+			return expression;
+		};
+
+		auto addExpressions = [&](const std::vector<Config::expression>& expressionConfigs, const std::vector<std::shared_ptr<Source>>& sources) {
+			for (const auto& expressionConfig : expressionConfigs) {
+				this->expressions_.push_back(makeExpression(expressionConfig));
+				this->expressionConfigs_.push_back(expressionConfig);
+				for (const auto& source : sources)
+					source->expressions().push_back(this->expressions_.back());
+				for (const auto& metric : expressionConfig.metrics)
+					this->hasSeriesBudgets_ |= (metric.maxSeries != 0 || expressionConfig.maxSeries != 0);
+			}
+		};
 
 		for (const auto& file : config.files) {
+			std::vector<std::shared_ptr<Source>> fileSources;
 			for (const auto& path : file.paths) {
-				auto paths = Source::filePathsMatchingGlobbingPattern(path);
-				for (const auto& p : paths)
-					this->sources_.push_back(std::make_shared<Source>(p));
-			}
-			for (const auto& expression : file.expressions) {
-				this->expressions_.push_back(std::make_shared<Expression>(expression.regex));
-				for (const auto& metric : expression.metrics) {
-					this->matchers_.push_back(std::make_shared<Matcher>(metric));
-					this->expressions_.back()->matchers().push_back(this->matchers_.back());
+				for (const auto& p : Source::filePathsMatchingGlobbingPattern(path)) {
+					auto source = makeSource(fileKey(p), [&] {
+						return std::make_shared<Source>(p);
+					});
+					if (std::find(fileSources.begin(), fileSources.end(), source) == fileSources.end())
+						fileSources.push_back(std::move(source));
 				}
-				for (auto itr = this->sources_.begin() + fileIndex; itr != this->sources_.end(); itr++)
-					(*itr)->expressions().push_back(this->expressions_.back());
 			}
-			fileIndex = this->sources_.size();
+			addExpressions(file.expressions, fileSources);
 		}
 
 		for (const auto& command : config.commands) {
-			this->sources_.push_back(std::make_shared<Source>(command.program, command.arguments));
-			for (const auto& expression : command.expressions) {
-				this->expressions_.push_back(std::make_shared<Expression>(expression.regex));
-				for (const auto& metric : expression.metrics) {
-					this->matchers_.push_back(std::make_shared<Matcher>(metric));
-					this->expressions_.back()->matchers().push_back(this->matchers_.back());
-				}
-				this->sources_.back()->expressions().push_back(this->expressions_.back());
+			std::vector<std::string> commandLine{command.program};
+			commandLine.insert(commandLine.end(), command.arguments.begin(), command.arguments.end());
+			auto source = makeSource(commandKey(commandLine), [&] {
+				return std::make_shared<Source>(command.program, command.arguments);
+			});
+			addExpressions(command.expressions, {source});
+		}
+
+		// Hand series over to the matchers replacing theirs, and forget the matchers which were removed
+		for (MetricStore::Index index = 0; index < this->metrics_.size(); index++) {
+			Matcher* owner = this->metrics_.owner(index);
+			if (owner == nullptr)
+				continue;
+			auto itr = matcherReplacements.find(owner);
+			if (itr == matcherReplacements.end()) {
+				this->metrics_.setOwner(index, nullptr);
+				this->matchedSeriesCount_--;
+			} else if (itr->second != owner) {
+				this->metrics_.setOwner(index, itr->second);
+				itr->second->accountSeries(1);
 			}
 		}
+
+		// Rejections are counted again under the new config, reused matchers included
+		for (const auto& matcher : this->matchers_) {
+			matcher->budget().rejectedSeriesCount = 0;
+			if (matcher->expressionBudget())
+				matcher->expressionBudget()->rejectedSeriesCount = 0;
+		}
+		this->applyMatcherFilter();
+		this->configHash_ = config.contentsHash;
+		this->restoreCounterCheckpoint();
 	}
 
 
-	void Controller::setSamplingInterval(std::chrono::seconds interval) noexcept {
+	void Controller::setSamplingInterval(std::chrono::milliseconds interval) noexcept {
 		if (this->isCollecting_)
 			return;
 
 		this->samplingInterval_ = interval;
 		if (interval != 0s)
-			this->unitsPerSecondFactor_ = 1.0 / interval.count();
+			this->unitsPerSecondFactor_ = 1.0 / std::chrono::duration<double>(interval).count();
 		else
 			this->unitsPerSecondFactor_ = 1.0;
 	}
 
+	void Controller::setVerifiesKeys(bool verifiesKeys) noexcept {
+		this->verifiesKeys_ = verifiesKeys;
+	}
+
+	void Controller::setStaleSeriesThreshold(size_t rounds) noexcept {
+		this->staleSeriesThreshold_ = rounds;
+	}
+
+	void Controller::setCompactionInterval(size_t rounds) noexcept {
+		this->compactionInterval_ = std::max<size_t>(rounds, 1);
+	}
+
+	void Controller::setMaxCollectDuration(std::chrono::milliseconds duration) noexcept {
+		this->maxCollectDuration_ = duration;
+	}
+
+	void Controller::setMatcherFilter(std::function<bool(const Matcher&)> filter) {
+		if (this->isCollecting_) {
+			std::lock_guard<std::mutex> lock(this->configMutex_);
+			this->pendingMatcherFilter_ = std::move(filter);
+			return;
+		}
+		this->matcherFilter_ = std::move(filter);
+		this->applyMatcherFilter();
+	}
+
+	void Controller::setMaxSeries(size_t maxSeries) noexcept {
+		this->maxSeries_ = maxSeries;
+	}
+
+	void Controller::setHistoryResolutions(std::vector<SeriesHistory::Resolution> resolutions) {
+		std::lock_guard<std::mutex> lock(this->storeMutex_);
+		this->metrics_.setHistoryResolutions(std::move(resolutions));
+	}
+
+	void Controller::setSpool(const std::string& directory, size_t maxSize, size_t segmentSize) {
+		if (directory.empty())
+			this->spool_.reset();
+		else if (this->spool_ == nullptr || this->spool_->directory() != directory)
+			this->spool_ = std::make_unique<Spool>(directory, segmentSize, maxSize / std::max<size_t>(segmentSize, 1));
+	}
+
+	void Controller::setSpoolReplayBatchSize(size_t batchSize) noexcept {
+		this->spoolReplayBatchSize_ = std::max<size_t>(batchSize, 1);
+	}
+
+	void Controller::setDispatchQueue(size_t queueSize, Dispatcher::OverflowPolicy overflowPolicy) {
+		if (this->isCollecting_)
+			return;
+		this->dispatcher_.reset();
+		if (queueSize > 0)
+			this->dispatcher_ = std::make_unique<Dispatcher>(*this, this->delegate_, queueSize, overflowPolicy);
+	}
+
+	void Controller::setEmitsSelfMetrics(bool emitsSelfMetrics) noexcept {
+		this->emitsSelfMetrics_ = emitsSelfMetrics;
+	}
+
+	void Controller::setPublishesSnapshots(bool publishesSnapshots) noexcept {
+		this->publishesSnapshots_ = publishesSnapshots;
+		if (!publishesSnapshots) {
+			std::atomic_store(&this->snapshot_, std::shared_ptr<const MetricSnapshot>());
+			this->spareSnapshot_.reset();
+		}
+	}
+
+
+	bool Controller::canCollect() const noexcept {
+		return !this->sources_.empty() && !this->expressions_.empty() && !this->matchers_.empty();
+	}
 
 	std::vector<const Metric*> Controller::availableMetrics() noexcept {
-		if (this->isCollecting_ || this->sources_.empty() || this->expressions_.empty() || this->matchers_.empty())
+		if (this->isCollecting_ || !this->canCollect())
 			return {};
 
-		this->roundKey_ += 10;
+		this->startCollectionRun();
 
-		this->updatedMetrics_.clear();
-		this->updateSources();
-		this->computeMatches();
+		this->updatedSeries_.clear();
+		this->collectSources(false);
+		this->checkCounters();
+		this->updateInternalMetrics();
+		this->filteredSeries_.clear();
 
-		this->updatedMetrics_.clear();
-		for (const auto& itr : this->metrics_)
-			this->updatedMetrics_.push_back(&itr.second);
+		this->updatedSeries_.clear();
+		for (MetricStore::Index index = 0; index < this->metrics_.size(); index++)
+			this->updatedSeries_.push_back(index);
+		this->publishUpdatedMetrics();
 
-		this->roundKey_ += 10;
+		this->startCollectionRun();
 		auto availableMetrics = std::move(this->updatedMetrics_);
 		this->updatedMetrics_.clear();
 		return availableMetrics;
 	}
 
 	void Controller::collectMetrics() noexcept {
-		if (this->isCollecting_ || this->sources_.empty() || this->expressions_.empty() || this->matchers_.empty())
+		if (!this->canCollect() || this->isCollecting_.exchange(true))
 			return;
-#if GPERFTOOLS_CPU_PROFILE
-		ProfilerStart("/tmp/aa.prof");
-#endif
-		this->isCollecting_ = true;
-		this->roundKey_ = 0;
-		auto startTime = std::chrono::steady_clock::now();
+		this->runCollection();
+	}
+
+	bool Controller::start() {
+		if (!this->canCollect() || this->isCollecting_.exchange(true))
+			return false;
+		if (this->thread_.joinable())
+			this->thread_.join();
+		this->thread_ = std::thread(&Controller::runCollection, this);
+		return true;
+	}
+
+	void Controller::stop() noexcept {
+		{
+			std::lock_guard<std::mutex> lock(this->stopMutex_);
+			if (!this->isCollecting_)
+				return;
+			this->isStopRequested_ = true;
+		}
+		this->stopCondition_.notify_all();
+	}
+
+	void Controller::join() {
+		if (this->thread_.joinable() && this->thread_.get_id() != std::this_thread::get_id())
+			this->thread_.join();
+	}
+
+	std::vector<const Metric*> Controller::collectOnce() noexcept {
+		if (!this->canCollect() || this->isCollecting_.exchange(true))
+			return {};
+
+		this->reloadModifiedConfigFile();
+		this->applyPendingConfig();
+		this->collectIteration();
+		this->writeCounterCheckpoint();
+		this->evictStaleSeries();
+		this->roundStatistics_.duration = std::chrono::steady_clock::now() - this->roundStatistics_.start;
 
+		{
+			std::lock_guard<std::mutex> lock(this->stopMutex_);
+			this->isStopRequested_ = false;
+			this->isCollecting_ = false;
+		}
+		auto metrics = std::move(this->updatedMetrics_);
 		this->updatedMetrics_.clear();
-		this->updateSources();
-		this->computeMatches();
+		return metrics;
+	}
 
-		while (true) {
-			std::this_thread::sleep_for(this->samplingInterval_ - (std::chrono::steady_clock::now() - startTime));
-			startTime = std::chrono::steady_clock::now();
 
-			this->updatedMetrics_.clear();
-			this->updateSources();
-			this->computeMatches();
+	bool Controller::waitUntil(std::chrono::system_clock::time_point deadline) noexcept {
+		std::unique_lock<std::mutex> lock(this->stopMutex_);
+		return !this->stopCondition_.wait_until(lock, deadline, [&] {
+			return this->isStopRequested_;
+		});
+	}
 
-			this->delegate_.contollerCollectedMetrics(*this, this->updatedMetrics_);
-			if (this->delegate_.contollerShouldStopCollectingMetrics(*this)) {
-				this->isCollecting_ = false;
+	void Controller::collectIteration() noexcept {
+		this->measuresRound_ = this->emitsSelfMetrics_;
+		this->roundStatistics_.start = std::chrono::steady_clock::now();
+		this->updatedSeries_.clear();
+		this->collectSources(true);
+		this->checkCounters();
+		this->updateInternalMetrics();
+		this->recordHistory();
+		this->filterUpdatedSeries();
+		this->publishUpdatedMetrics();
+		this->publishSnapshot();
+	}
+
+	void Controller::runCollection() noexcept {
 #if GPERFTOOLS_CPU_PROFILE
-				ProfilerStop();
+		ProfilerStart("/tmp/aa.prof");
 #endif
-				return;
-			}
+		this->startCollectionRun();
+
+		// Rate series restored from the counter checkpoint need no priming iteration, so the first one is delivered right away
+		bool isPrimed = this->checkpointedSeries_.empty();
+		auto deadline = std::chrono::system_clock::now();
+		if (isPrimed) {
+			this->updatedSeries_.clear();
+			this->collectSources(true);
+			this->checkCounters();
+			this->filteredSeries_.clear();
+			this->writeCounterCheckpoint();
+			deadline = this->nextSamplingDeadline(deadline);
+		}
+
+		while (this->waitUntil(deadline)) {
+			this->reloadModifiedConfigFile();
+			this->applyPendingConfig();
+			this->collectIteration();
+			this->writeCounterCheckpoint();
+			auto deliveryStart = std::chrono::steady_clock::now();
+			this->deliverUpdatedMetrics();
+			this->evictStaleSeries();
+			auto end = std::chrono::steady_clock::now();
+			this->roundStatistics_.deliveryDuration = end - deliveryStart;
+			this->roundStatistics_.duration = end - this->roundStatistics_.start;
+			if (this->delegate_.contollerShouldStopCollectingMetrics(*this))
+				break;
 #if GPERFTOOLS_CPU_PROFILE
 			ProfilerFlush();
 #endif
+
+			// Skip the deadlines already missed rather than running late iterations back to back
+			deadline += this->samplingInterval_;
+			auto now = std::chrono::system_clock::now();
+			if (!isPrimed) {
+				isPrimed = true;
+				deadline = this->nextSamplingDeadline(now);
+			} else if (deadline <= now && this->samplingInterval_.count() > 0) {
+				auto next = this->nextSamplingDeadline(now);
+				this->missedRoundCount_ += (next - deadline) / this->samplingInterval_;
+				deadline = next;
+			}
+		}
+
+		if (this->dispatcher_ != nullptr)
+			this->dispatcher_->flush();
+		{
+			std::lock_guard<std::mutex> lock(this->stopMutex_);
+			this->isStopRequested_ = false;
+			this->isCollecting_ = false;
 		}
+#if GPERFTOOLS_CPU_PROFILE
+		ProfilerStop();
+#endif
 	}
 
 
-	void Controller::updateSources() noexcept {
-		for (auto& source : this->sources_)
-			source->update();
+	void Controller::collectSources(bool hasDeadline) noexcept {
+		hasDeadline &= (this->maxCollectDuration_.count() > 0);
+		auto deadline = std::chrono::steady_clock::now() + this->maxCollectDuration_;
+		size_t sourceCount = this->sources_.size();
+		size_t firstSourceIndex = (this->firstSourceIndex_ < sourceCount) ? this->firstSourceIndex_ : 0;
+
+		size_t collectedCount = 0;
+		size_t i = 0;
+		for (; i < sourceCount; i++) {
+			auto& source = *this->sources_[(firstSourceIndex + i) % sourceCount];
+			if (!source.isEnabled())
+				continue;
+			if (hasDeadline && collectedCount > 0 && std::chrono::steady_clock::now() >= deadline)
+				break;
+			// Series continue from the previous reading of their source, even if it missed iterations since (deferred or skipped by rotation)
+			this->sourceRoundKey_ = (source.readRoundKey() >= this->runRoundKey_) ? source.readRoundKey() : 0;
+			source.setReadRoundKey(this->roundKey_);
+			if (this->measuresRound_) {
+				auto start = std::chrono::steady_clock::now();
+				source.update();
+				auto read = std::chrono::steady_clock::now();
+				this->computeMatches(source);
+				source.statistics() = Source::Statistics{read - start, source.contents().size()};
+				this->roundStatistics_.readDuration += read - start;
+				this->roundStatistics_.matchDuration += std::chrono::steady_clock::now() - read;
+			} else {
+				source.update();
+				this->computeMatches(source);
+			}
+			collectedCount++;
+		}
+		// The counter checkpoint is kept until the first collection round: listing available metrics does not use it up
+		if (this->isCollecting_)
+			this->checkpointedSeries_.clear();
+
+		// Start with the deferred sources next time, so that the same sources are not always deferred
+		this->firstSourceIndex_ = (sourceCount > 0) ? (firstSourceIndex + i) % sourceCount : 0;
+		for (; i < sourceCount; i++) {
+			const auto& source = *this->sources_[(firstSourceIndex + i) % sourceCount];
+			if (!source.isEnabled())
+				continue;
+			this->deferredSourceCounts_[source.path()]++;
+			this->deferredSourceCount_++;
+		}
+		this->roundKey_++;
+		this->roundCount_++;
 	}
 
-	void Controller::computeMatches() noexcept {
-		for (const auto& source : this->sources_) {
-			auto begin = source->begin();
-			while(begin != source->end()) {
-				auto end = source->getLine(begin);
-				if (begin != end) {
-					for (const auto& expression : source->expressions()) {
-						auto& match = expression->apply(begin, end);
-						if (!match.empty()) {
-							for (const auto& matcher : expression->matchers())
-								this->parseData(*source, match, *matcher);
+	void Controller::computeMatches(const Source& source) noexcept {
+		bool isMeasured = this->measuresRound_;
+		auto begin = source.begin();
+		while(begin != source.end()) {
+			auto end = source.getLine(begin);
+			if (begin != end) {
+				for (const auto& expression : source.expressions()) {
+					if (!expression->isEnabled())
+						continue;
+					auto start = isMeasured ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+					auto& match = expression->apply(begin, end);
+					if (isMeasured) {
+						auto& statistics = expression->statistics();
+						statistics.attemptCount++;
+						statistics.matchCount += !match.empty();
+						statistics.matchDuration += std::chrono::steady_clock::now() - start;
+					}
+					if (!match.empty()) {
+						for (const auto& matcher : expression->matchers()) {
+							if (matcher->isEnabled())
+								this->parseData(source, match, *matcher);
 						}
 					}
 				}
-				if (end != source->end())
-					begin = end + 1;
-				else
-					break;
 			}
+			if (end != source.end())
+				begin = end + 1;
+			else
+				break;
 		}
-		this->roundKey_++;
 	}
 
-	void Controller::parseData(const Source& source, const std::cmatch& match, const Matcher& matcher) noexcept {
+	std::chrono::system_clock::time_point Controller::nextSamplingDeadline(std::chrono::system_clock::time_point now) const noexcept {
+		if (this->samplingInterval_.count() <= 0)
+			return now;
+		auto interval = std::chrono::duration_cast<std::chrono::system_clock::duration>(this->samplingInterval_);
+		return std::chrono::system_clock::time_point{(now.time_since_epoch() / interval + 1) * interval};
+	}
+
+	void Controller::startCollectionRun() noexcept {
+		this->roundKey_ += 10;
+		this->runRoundKey_ = this->roundKey_;
+	}
+
+	double Controller::rateFactor(MetricStore::Index index, std::chrono::system_clock::time_point timestamp, bool convertsToUnitsPerSecond) const noexcept {
+		if (!convertsToUnitsPerSecond && this->samplingInterval_.count() <= 0)
+			return 1.0;
+		std::chrono::duration<double> elapsed = timestamp - this->metrics_.timestamp(index);
+		if (this->metrics_.roundKey(index) == static_cast<size_t>(-1) || elapsed.count() <= 0)
+			return convertsToUnitsPerSecond ? this->unitsPerSecondFactor_ : 1.0;
+		if (convertsToUnitsPerSecond)
+			return 1.0 / elapsed.count();
+		return std::chrono::duration<double>(this->samplingInterval_).count() / elapsed.count();
+	}
+
+	void Controller::parseData(const Source& source, const std::cmatch& match, Matcher& matcher) noexcept {
 		auto value = matcher.getValue(match, source.pathParts());
-		if (!value.has_value())
-			return;
-		auto newMetric = matcher.getMetric(match, source.pathParts());
-		if (!newMetric.has_value())
+		auto key = value.has_value() ? matcher.getKey(match, source.pathParts()) : std::nullopt;
+		if (!key.has_value()) {
+			if (this->measuresRound_)
+				matcher.statistics().failureCount++;
 			return;
+		}
 
-		auto itr = this->metrics_.find(newMetric.value().key());
-		bool isNew = (itr == this->metrics_.end());
-		if (isNew)
-			itr = this->metrics_.insert_or_assign(this->metrics_.begin(), newMetric.value().key(), std::move(newMetric.value()));
+		auto index = this->metrics_.find(key.value());
+		bool isNew = (index == MetricStore::npos);
+		if (isNew) {
+			std::optional<Metric> newMetric;
+			if (matcher.canCreateSeries() && (this->maxSeries_ == 0 || this->matchedSeriesCount_ < this->maxSeries_)) {
+				newMetric = matcher.getMetric(match, source.pathParts());
+				// A full string pool rejects the series like an exhausted budget, anything else is a matching failure, as is a substituted name under the reserved prefix
+				bool isReserved = newMetric.has_value() && !newMetric.value().nameIds().empty() && StringPool::shared().string(newMetric.value().nameIds().front()) == Controller::internalMetricPrefix;
+				if ((!newMetric.has_value() && !StringPool::shared().isFull()) || isReserved) {
+					if (this->measuresRound_)
+						matcher.statistics().failureCount++;
+					return;
+				}
+			}
+			if (newMetric.has_value()) {
+				index = this->insertSeries(newMetric.value().identity(), &matcher);
+				matcher.accountSeries(1);
+				this->matchedSeriesCount_++;
+			} else {
+				// A rejected series shows up again every round, but is only counted once
+				if (this->rejectedKeys_.size() < Controller::maxTrackedRejectedSeries && this->rejectedKeys_.insert(key.value()).second) {
+					matcher.accountRejectedSeries();
+					this->rejectedSeriesCount_++;
+				}
+				if (matcher.overflowPolicy() != Matcher::OverflowPolicyFold || matcher.overflowIdentity() == nullptr)
+					return;
+				index = this->metrics_.find(matcher.overflowIdentity()->key);
+				if (index == MetricStore::npos)
+					index = this->insertSeries(matcher.overflowIdentity());
+				isNew = false;
+			}
+		} else if (this->verifiesKeys_) {
+			auto newMetric = matcher.getMetric(match, source.pathParts());
+			const auto& identity = *this->metrics_.identity(index);
+			if (newMetric.has_value() && (newMetric.value().nameIds() != identity.name || newMetric.value().tagIds() != identity.tags)) {
+				if (this->keyCollisionCount_ == 0)
+					std::cerr << "Series key collision detected, colliding samples are dropped (further collisions are only counted)." << std::endl;
+				this->keyCollisionCount_++;
+				return;
+			}
+		}
 
-		Metric& metric = itr->second;
-		isNew = (isNew || (metric.roundKey() != this->roundKey_ - 1));
-		if (metric.roundKey() != this->roundKey_) {
-			metric.setNewValue(value.value(), matcher.computeRate(), matcher.convertToUnitsPerSecond() ? this->unitsPerSecondFactor_ : 1.0);
-			if ((!isNew || !matcher.computeRate()))
-				this->updatedMetrics_.push_back(&metric);
+		// A series is only primed again if it was missing from the previous reading of its source, or takes its previous value from the counter checkpoint in the first collection round
+		size_t roundKey = this->metrics_.roundKey(index);
+		isNew = (isNew || (roundKey != this->sourceRoundKey_));
+		if (isNew && roundKey != this->roundKey_ && matcher.computeRate() && !this->checkpointedSeries_.empty() && this->restoreCheckpointedSeries(index, this->metrics_.key(index))) {
+			isNew = false;
+			roundKey = this->metrics_.roundKey(index);
+		}
+		if (roundKey != this->roundKey_) {
+			double factor = (matcher.computeRate() || matcher.convertToUnitsPerSecond()) ? this->rateFactor(index, source.timestamp(), matcher.convertToUnitsPerSecond()) : 1.0;
+			this->metrics_.setNewValue(index, value.value(), matcher.computeRate(), factor);
+			if (matcher.computeRate() && matcher.counterType() != Matcher::CounterTypeNone)
+				this->counterSeries_.emplace_back(index, matcher.counterType());
+			if ((!isNew || !matcher.computeRate())) {
+				this->updatedSeries_.push_back(index);
+				if (matcher.emission() != Matcher::EmissionAlways)
+					this->filteredSeries_.emplace_back(index, &matcher);
+			}
 		} else {
-			metric.updateValue(value.value(), matcher.convertToUnitsPerSecond() ? this->unitsPerSecondFactor_ : 1.0);
+			this->metrics_.updateValue(index, value.value());
+		}
+		this->metrics_.setTimestamp(index, source.timestamp());
+		this->metrics_.setRoundKey(index, this->roundKey_);
+		this->metrics_.setUpdateRound(index, this->roundCount_);
+	}
+
+	void Controller::restoreCounterCheckpoint() {
+		if (this->counterCheckpoint_ == nullptr || this->isCounterCheckpointRestored_)
+			return;
+		this->isCounterCheckpointRestored_ = true;
+		for (const auto& entry : this->counterCheckpoint_->read(this->configHash_))
+			this->checkpointedSeries_.emplace(entry.key, entry);
+	}
+
+	void Controller::writeCounterCheckpoint() noexcept {
+		if (this->counterCheckpoint_ == nullptr)
+			return;
+		auto* entries = this->counterCheckpoint_->entries(this->metrics_.size());
+		if (entries == nullptr)
+			return;
+		size_t count = 0;
+		for (MetricStore::Index index = 0; index < this->metrics_.size(); index++) {
+			const Matcher* owner = this->metrics_.owner(index);
+			if (owner == nullptr || !owner->computeRate() || this->metrics_.roundKey(index) == static_cast<size_t>(-1))
+				continue;
+			auto timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(this->metrics_.timestamp(index).time_since_epoch());
+			entries[count++] = CounterCheckpoint::Entry{this->metrics_.key(index), this->metrics_.previousValue(index), timestamp.count()};
 		}
-		metric.setTimestamp(source.timestamp());
-		metric.setRoundKey(this->roundKey_);
+		this->counterCheckpoint_->commit(this->configHash_, count);
+	}
+
+	bool Controller::restoreCheckpointedSeries(MetricStore::Index index, const Key& key) noexcept {
+		auto entry = this->checkpointedSeries_.find(key);
+		if (entry == this->checkpointedSeries_.end())
+			return false;
+		auto timestamp = std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(entry->second.timestamp));
+		this->metrics_.setPreviousValue(index, entry->second.previousValue);
+		this->metrics_.setTimestamp(index, std::chrono::system_clock::time_point(timestamp));
+		this->metrics_.setRoundKey(index, this->sourceRoundKey_);
+		return true;
 	}
 
+	void Controller::checkCounters() noexcept {
+		if (this->counterSeries_.empty())
+			return;
+
+		constexpr double wrap32 = 4294967296.0;
+		constexpr double wrap64 = 18446744073709551616.0;
+		std::vector<MetricStore::Index> resetSeries;
+		for (const auto& [index, counterType] : this->counterSeries_) {
+			double delta = this->metrics_.delta(index);
+			if (delta >= 0)
+				continue;
+			double value = this->metrics_.previousValue(index);
+			double previousValue = value - delta;
+			// A counter can only have wrapped if it was in the upper half of its range
+			if (counterType == Matcher::CounterTypeWrap32 && previousValue >= wrap32 / 2 && previousValue < wrap32) {
+				this->metrics_.setDelta(index, delta + wrap32);
+			} else if (counterType == Matcher::CounterTypeWrap64 && previousValue >= wrap64 / 2) {
+				this->metrics_.setDelta(index, (wrap64 - previousValue) + value);
+			} else if (counterType == Matcher::CounterTypeResetToZero) {
+				this->metrics_.countReset(index);
+				this->metrics_.setDelta(index, value);
+			} else {
+				this->metrics_.countReset(index);
+				resetSeries.push_back(index);
+			}
+		}
+		this->counterSeries_.clear();
+
+		if (!resetSeries.empty()) {
+			std::sort(resetSeries.begin(), resetSeries.end());
+			this->updatedSeries_.erase(std::remove_if(this->updatedSeries_.begin(), this->updatedSeries_.end(), [&](MetricStore::Index index) {
+				return std::binary_search(resetSeries.begin(), resetSeries.end(), index);
+			}), this->updatedSeries_.end());
+			this->filteredSeries_.erase(std::remove_if(this->filteredSeries_.begin(), this->filteredSeries_.end(), [&](const auto& series) {
+				return std::binary_search(resetSeries.begin(), resetSeries.end(), series.first);
+			}), this->filteredSeries_.end());
+		}
+	}
+
+	void Controller::filterUpdatedSeries() noexcept {
+		if (this->filteredSeries_.empty())
+			return;
+
+		std::vector<MetricStore::Index> suppressedSeries;
+		for (const auto& [index, matcher] : this->filteredSeries_) {
+			size_t emittedRound = this->metrics_.emittedRound(index);
+			size_t roundsSinceEmission = this->roundCount_ - emittedRound;
+			if (emittedRound == static_cast<size_t>(-1) || matcher->shouldEmit(this->metrics_.value(index), this->metrics_.emittedValue(index), roundsSinceEmission))
+				this->metrics_.setEmitted(index, this->roundCount_);
+			else
+				suppressedSeries.push_back(index);
+		}
+		this->filteredSeries_.clear();
+
+		if (!suppressedSeries.empty()) {
+			std::sort(suppressedSeries.begin(), suppressedSeries.end());
+			size_t size = this->updatedSeries_.size();
+			this->updatedSeries_.erase(std::remove_if(this->updatedSeries_.begin(), this->updatedSeries_.end(), [&](MetricStore::Index index) {
+				return std::binary_search(suppressedSeries.begin(), suppressedSeries.end(), index);
+			}), this->updatedSeries_.end());
+			this->suppressedValueCount_ += size - this->updatedSeries_.size();
+		}
+	}
+
+	void Controller::setInternalMetric(const std::vector<std::string>& name, const std::map<std::string, std::string>& tags, double value) noexcept {
+		std::vector<std::string> fullName{std::string(Controller::internalMetricPrefix)};
+		fullName.insert(fullName.end(), name.begin(), name.end());
+		Key key = Metric::generateKey(fullName, tags);
+
+		auto index = this->metrics_.find(key);
+		if (index == MetricStore::npos) {
+			// Without room in the string pool, the internal metric is skipped until there is
+			auto metric = Metric::make(fullName, tags);
+			if (!metric.has_value())
+				return;
+			index = this->insertSeries(metric.value().identity());
+		}
+		this->metrics_.setNewValue(index, value, false);
+		this->metrics_.setTimestamp(index, std::chrono::system_clock::now());
+		this->metrics_.setRoundKey(index, this->roundKey_);
+		this->metrics_.setUpdateRound(index, this->roundCount_);
+		this->updatedSeries_.push_back(index);
+	}
+
+	MetricStore::Index Controller::insertSeries(std::shared_ptr<const Metric::Identity> identity, Matcher* owner) {
+		std::lock_guard<std::mutex> lock(this->storeMutex_);
+		return this->metrics_.insert(std::move(identity), owner);
+	}
+
+	void Controller::updateInternalMetrics() noexcept {
+		if (this->hasSeriesBudgets_ || this->maxSeries_ != 0 || this->rejectedSeriesCount_ != 0) {
+			this->setInternalMetric({"series", "rejected"}, {}, this->rejectedSeriesCount_);
+			for (const auto& matcher : this->matchers_) {
+				if (matcher->budget().rejectedSeriesCount != 0)
+					this->setInternalMetric({"series", "rejected"}, {{"metric", namePattern(*matcher)}}, matcher->budget().rejectedSeriesCount);
+			}
+		}
+		if (this->staleSeriesThreshold_ != 0)
+			this->setInternalMetric({"series", "evicted"}, {}, this->evictedSeriesCount_);
+		if (this->maxCollectDuration_.count() > 0) {
+			this->setInternalMetric({"sources", "deferred"}, {}, this->deferredSourceCount_);
+			for (const auto& [path, count] : this->deferredSourceCounts_)
+				this->setInternalMetric({"sources", "deferred"}, {{"source", path}}, count);
+		}
+		if (this->dispatcher_ != nullptr) {
+			this->setInternalMetric({"dispatch", "queue_depth"}, {}, this->dispatcher_->queueDepth());
+			this->setInternalMetric({"dispatch", "latency_us"}, {}, this->dispatcher_->lastDeliveryLatency().count());
+			this->setInternalMetric({"dispatch", "dropped"}, {}, this->dispatcher_->droppedBatchCount());
+			this->setInternalMetric({"dispatch", "coalesced"}, {}, this->dispatcher_->coalescedBatchCount());
+		}
+		if (this->measuresRound_)
+			this->updateSelfMetrics();
+	}
+
+	void Controller::updateSelfMetrics() noexcept {
+		auto microseconds = [](std::chrono::nanoseconds duration) {
+			return std::chrono::duration<double, std::micro>(duration).count();
+		};
+
+		auto& round = this->roundStatistics_;
+		this->setInternalMetric({"self", "round", "read_us"}, {}, microseconds(round.readDuration));
+		this->setInternalMetric({"self", "round", "match_us"}, {}, microseconds(round.matchDuration));
+		this->setInternalMetric({"self", "round", "delivery_us"}, {}, microseconds(round.deliveryDuration));
+		this->setInternalMetric({"self", "round", "duration_us"}, {}, microseconds(round.duration));
+		this->setInternalMetric({"self", "series"}, {}, this->metrics_.size());
+		round.readDuration = round.matchDuration = std::chrono::nanoseconds{0};
+
+		for (const auto& source : this->sources_) {
+			if (!source->isEnabled())
+				continue;
+			auto& statistics = source->statistics();
+			std::map<std::string, std::string> tags{{"source", source->path()}};
+			this->setInternalMetric({"self", "source", "read_us"}, tags, microseconds(statistics.readDuration));
+			this->setInternalMetric({"self", "source", "bytes"}, tags, statistics.readSize);
+			statistics = {};
+		}
+		for (size_t i = 0; i < this->expressions_.size(); i++) {
+			if (!this->expressions_[i]->isEnabled())
+				continue;
+			auto& statistics = this->expressions_[i]->statistics();
+			std::map<std::string, std::string> tags{{"expression", this->expressionConfigs_[i].regex}};
+			this->setInternalMetric({"self", "expression", "attempts"}, tags, statistics.attemptCount);
+			this->setInternalMetric({"self", "expression", "matches"}, tags, statistics.matchCount);
+			this->setInternalMetric({"self", "expression", "match_us"}, tags, microseconds(statistics.matchDuration));
+			statistics = {};
+		}
+		for (const auto& matcher : this->matchers_) {
+			if (!matcher->isEnabled())
+				continue;
+			this->setInternalMetric({"self", "matcher", "failures"}, {{"metric", namePattern(*matcher)}}, matcher->statistics().failureCount);
+			matcher->statistics() = {};
+		}
+	}
+
+	void Controller::publishUpdatedMetrics() noexcept {
+		this->roundMetrics_.clear();
+		this->roundMetrics_.reserve(this->updatedSeries_.size());
+		for (auto index : this->updatedSeries_)
+			this->roundMetrics_.push_back(this->metrics_.metric(index));
+
+		this->updatedMetrics_.clear();
+		this->updatedMetrics_.reserve(this->roundMetrics_.size());
+		for (const auto& metric : this->roundMetrics_)
+			this->updatedMetrics_.push_back(&metric);
+	}
+
+	void Controller::deliverUpdatedMetrics() noexcept {
+		if (this->spool_ == nullptr) {
+			if (this->dispatcher_ != nullptr) {
+				this->updatedMetrics_.clear();
+				this->dispatcher_->dispatchMetrics(this->roundMetrics_);
+			} else
+				this->delegate_.contollerCollectedMetrics(*this, this->updatedMetrics_);
+			return;
+		}
+
+		bool canPublish = this->delegate_.contollerCanPublishMetrics(*this);
+		if (canPublish && this->spool_->pendingRoundCount() > 0) {
+			std::vector<const Metric*> batchMetrics;
+			canPublish = this->spool_->replay([&](const std::vector<Metric>& batch) {
+				if (!this->delegate_.contollerCanPublishMetrics(*this))
+					return false;
+				if (this->dispatcher_ != nullptr) {
+					std::vector<Metric> metrics = batch;
+					this->dispatcher_->dispatchMetrics(metrics);
+					return true;
+				}
+				batchMetrics.clear();
+				for (const auto& metric : batch)
+					batchMetrics.push_back(&metric);
+				this->delegate_.contollerCollectedMetrics(*this, batchMetrics);
+				return true;
+			}, this->spoolReplayBatchSize_);
+		}
+
+		if (canPublish && this->dispatcher_ != nullptr) {
+			this->updatedMetrics_.clear();
+			this->dispatcher_->dispatchMetrics(this->roundMetrics_);
+		} else if (canPublish)
+			this->delegate_.contollerCollectedMetrics(*this, this->updatedMetrics_);
+		else if (!this->roundMetrics_.empty())
+			this->spool_->append(this->roundMetrics_);
+	}
+
+	void Controller::publishSnapshot() {
+		if (!this->publishesSnapshots_)
+			return;
+
+		// Readers only get snapshots through `snapshot_`, so the spare one cannot be acquired again once it is only held here.
+		// `use_count` is a relaxed load: the fence makes the last reader's accesses, released when it dropped its reference, visible before the snapshot is rewritten.
+		std::shared_ptr<MetricSnapshot> snapshot;
+		if (this->spareSnapshot_ != nullptr && this->spareSnapshot_.use_count() == 1) {
+			std::atomic_thread_fence(std::memory_order_acquire);
+			snapshot = std::move(this->spareSnapshot_);
+		} else
+			snapshot = std::make_shared<MetricSnapshot>();
+		this->spareSnapshot_.reset();
+
+		snapshot->roundKey = this->roundKey_;
+		snapshot->timestamp = std::chrono::system_clock::now();
+		snapshot->metrics.clear();
+		snapshot->metrics.reserve(this->metrics_.size());
+		for (MetricStore::Index index = 0; index < this->metrics_.size(); index++)
+			snapshot->metrics.push_back(this->metrics_.metric(index));
+
+		auto previous = std::atomic_exchange(&this->snapshot_, std::shared_ptr<const MetricSnapshot>(snapshot));
+		this->spareSnapshot_ = std::const_pointer_cast<MetricSnapshot>(previous);
+	}
+
+	void Controller::recordHistory() noexcept {
+		if (!this->metrics_.history().isEnabled())
+			return;
+		std::lock_guard<std::mutex> lock(this->storeMutex_);
+		for (auto index : this->updatedSeries_)
+			this->metrics_.recordHistory(index);
+	}
+
+	void Controller::evictStaleSeries() noexcept {
+		if (this->staleSeriesThreshold_ == 0)
+			return;
+		this->roundsSinceCompaction_++;
+		if (this->roundsSinceCompaction_ < this->compactionInterval_)
+			return;
+		this->roundsSinceCompaction_ = 0;
+
+		std::vector<Key> evictedKeys;
+		std::unique_lock<std::mutex> lock(this->storeMutex_);
+		this->metrics_.compact([&](MetricStore::Index index) {
+			if (this->roundCount_ - this->metrics_.updateRound(index) <= this->staleSeriesThreshold_)
+				return false;
+			evictedKeys.push_back(this->metrics_.key(index));
+			if (this->metrics_.owner(index) != nullptr) {
+				this->metrics_.owner(index)->accountSeries(-1);
+				this->matchedSeriesCount_--;
+			}
+			return true;
+		});
+		lock.unlock();
+
+		if (!evictedKeys.empty()) {
+			this->evictedSeriesCount_ += evictedKeys.size();
+			if (this->dispatcher_ != nullptr)
+				this->dispatcher_->dispatchEvictedKeys(std::move(evictedKeys));
+			else
+				this->delegate_.contollerEvictedMetrics(*this, evictedKeys);
+		}
+	}
+
+
+	void ControllerDelegate::contollerEvictedMetrics(const Controller& , const std::vector<Key>& ) { }
+
+	bool ControllerDelegate::contollerCanPublishMetrics(const Controller& ) {
+		return true;
+	}
 }
@@ -20,15 +20,33 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <mutex>
 #include <regex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "Config.h"
+#include "ConfigCache.h"
+#include "CounterCheckpoint.h"
 #include "Source.h"
+#include "Dispatcher.h"
 #include "Expression.h"
 #include "Matcher.h"
 #include "Metric.h"
+#include "MetricSnapshot.h"
+#include "MetricStore.h"
+#include "Spool.h"
 
 using namespace std::literals;
 
@@ -43,34 +61,205 @@ namespace AnyCollect {
 	class Controller {
 		public:
 #if PROFILING
-			static constexpr std::chrono::seconds defaultSamplingInterval = 0s;			//!< Default parameter option
+			static constexpr std::chrono::milliseconds defaultSamplingInterval = 0s;	//!< Default parameter option
 #else
-			static constexpr std::chrono::seconds defaultSamplingInterval = 10s;		//!< Default parameter option
+			static constexpr std::chrono::milliseconds defaultSamplingInterval = 10s;	//!< Default parameter option
 #endif
+			static constexpr size_t defaultStaleSeriesThreshold = 0;					//!< Default parameter option (series are never evicted)
+			static constexpr size_t defaultCompactionInterval = 10;						//!< Default parameter option
+			static constexpr std::chrono::milliseconds defaultMaxCollectDuration = 0s;	//!< Default parameter option (no limit)
+			static constexpr size_t defaultMaxSeries = 0;								//!< Default parameter option (no limit)
+			static constexpr size_t maxTrackedRejectedSeries = 1 << 16;					//!< Maximum number of rejected series keys remembered, beyond which rejections of other series are not counted
+			static constexpr size_t defaultSpoolSegmentSize = 4 << 20;					//!< Default parameter option
+			static constexpr size_t defaultSpoolReplayBatchSize = 10000;				//!< Default parameter option
+			static constexpr std::string_view internalMetricPrefix = "anycollect"sv;	//!< Name prefix of the metrics describing the controller itself, reserved: configured metrics cannot use it
 
 		protected:
+			/**
+			 * @brief Durations of the stages of an iteration, kept when self metrics are enabled
+			 */
+			struct RoundStatistics {
+				std::chrono::steady_clock::time_point start;		//!< Time the iteration started at
+				std::chrono::nanoseconds readDuration{0};			//!< Time spent reading sources
+				std::chrono::nanoseconds matchDuration{0};			//!< Time spent matching source contents and updating series
+				std::chrono::nanoseconds deliveryDuration{0};		//!< Time spent giving metrics to the delegate
+				std::chrono::nanoseconds duration{0};				//!< Time spent in the whole iteration
+			};
+
 			ControllerDelegate& delegate_;												//!< Delegate to alert when something happens
 
-			bool isCollecting_;															//!< Whether the receiver is collecting metrics
-			std::chrono::seconds samplingInterval_;										//!< Metrics sampling interval
-			double unitsPerSecondFactor_;												//!< Factor to convert metric differences to units per second
-			size_t roundKey_;															//!< Metric collection iteration unique identifier
+			std::atomic<bool> isCollecting_;											//!< Whether the receiver is collecting metrics
+			bool isStopRequested_;														//!< Whether the collection loop should stop as soon as possible
+			std::mutex stopMutex_;														//!< Mutex protecting `isStopRequested_`
+			std::condition_variable stopCondition_;										//!< Condition notified when the collection loop should stop, waking it up
+			std::thread thread_;														//!< Collection thread, if started with `start`
+			std::chrono::milliseconds samplingInterval_;								//!< Metrics sampling interval
+			double unitsPerSecondFactor_;												//!< Factor to convert metric differences to units per second, when the elapsed time is unknown
+			size_t missedRoundCount_;													//!< Number of collection iterations skipped because the previous ones ran late
+			size_t roundKey_;															//!< Metric collection iteration unique identifier, starting at 1 so that the previous iteration of the first one is not mistaken for the "never updated" key
+			size_t roundCount_;															//!< Number of collection rounds run so far (unlike `roundKey_`, it counts rounds one by one, for stale series and heartbeats)
+			size_t runRoundKey_;														//!< Round key of the first iteration of the current collection run: sources read before it start over, so that rates are not computed across runs
+			size_t sourceRoundKey_;														//!< Round key of the previous reading of the source being parsed (0 if its series start over), which its continuing series were updated with
+			bool verifiesKeys_;															//!< Whether series identities are compared when their keys match
+			size_t keyCollisionCount_;													//!< Number of key collisions detected so far
+			size_t staleSeriesThreshold_;												//!< Number of rounds without update after which a series is evicted (0 to never evict)
+			size_t compactionInterval_;													//!< Number of rounds between two stale series evictions
+			size_t roundsSinceCompaction_;												//!< Number of rounds since the last stale series eviction
+			size_t evictedSeriesCount_;													//!< Number of series evicted so far
+			std::chrono::milliseconds maxCollectDuration_;								//!< Maximum time spent reading sources in an iteration (0 for no limit)
+			size_t firstSourceIndex_;													//!< Index of the source read first in the next iteration
+			size_t deferredSourceCount_;												//!< Number of source readings deferred so far because of the maximum collect duration
+			std::map<std::string, size_t> deferredSourceCounts_;						//!< Map associating source paths to their number of deferred readings
+			size_t maxSeries_;															//!< Maximum number of series created by matchers (0 for no limit)
+			size_t matchedSeriesCount_;													//!< Number of series created by the current matchers, counted against `maxSeries_` (internal and overflow series are not)
+			size_t rejectedSeriesCount_;												//!< Number of distinct new series rejected because of exhausted budgets since the config was applied
+			std::unordered_set<Key> rejectedKeys_;										//!< Keys of the series counted in `rejectedSeriesCount_`, so that each one is only counted once
+			bool hasSeriesBudgets_;														//!< Whether any series budget is configured
 
 			std::vector<std::shared_ptr<Source>> sources_;								//!< Array of sources
 			std::vector<std::shared_ptr<Expression>> expressions_;						//!< Array of expressions
 			std::vector<std::shared_ptr<Matcher>> matchers_;							//!< Array of matchers
-			std::map<size_t, Metric> metrics_;											//!< Map associating keys to their metric
+			std::vector<Config::expression> expressionConfigs_;							//!< Configuration of each expression, in `expressions_` order, used to find unchanged expressions on reload
+			std::string configPath_;													//!< Path of the last loaded config file
+			std::time_t configWriteTime_;												//!< Last modification time of the config file when it was loaded
+			bool watchesConfigFile_;													//!< Whether the config file is reloaded when it is modified
+			std::string configCachePath_;												//!< Path of the binary config cache (empty if disabled)
+			Key configHash_;															//!< Hash of the JSON contents of the applied config
+			std::mutex configMutex_;													//!< Mutex protecting the pending config, its path and modification time, and `pendingMatcherFilter_`
+			std::unique_ptr<Config> pendingConfig_;										//!< Config loaded while collecting, applied at the beginning of the next iteration
+			std::string pendingConfigPath_;												//!< Path of `pendingConfig_`, which becomes `configPath_` once applied
+			std::time_t pendingConfigWriteTime_;										//!< Modification time of `pendingConfig_`, which becomes `configWriteTime_` once applied
+			std::function<bool(const Matcher&)> matcherFilter_;							//!< Predicate selecting the matchers to evaluate (all of them if empty)
+			std::optional<std::function<bool(const Matcher&)>> pendingMatcherFilter_;	//!< Matcher filter set while collecting, applied at the beginning of the next iteration
+			MetricStore metrics_;														//!< Store of every series state, indexed by key
+			mutable std::mutex storeMutex_;												//!< Mutex taken by the collector when it inserts or evicts series or records history, and by `history` queries (the collector's own reads of `metrics_` do not take it)
+			std::vector<MetricStore::Index> updatedSeries_;								//!< Array of indexes of the iteration's updated series
+			std::vector<std::pair<MetricStore::Index, Matcher::CounterType>> counterSeries_;	//!< Array of the iteration's rate series whose matcher has a counter type
+			std::vector<std::pair<MetricStore::Index, const Matcher*>> filteredSeries_;		//!< Array of the iteration's series whose matcher has an emission policy
+			size_t suppressedValueCount_;												//!< Number of values not given to the delegate because of emission policies
+			std::vector<Metric> roundMetrics_;											//!< Array of the iteration's metrics, built from updated series
 			std::vector<const Metric*> updatedMetrics_;									//!< Array of pointers to the iteration's metrics
+			std::unique_ptr<CounterCheckpoint> counterCheckpoint_;						//!< Checkpoint of the previous values of rate series, if enabled
+			bool isCounterCheckpointRestored_;											//!< Whether the counter checkpoint was read since it was enabled
+			std::unordered_map<Key, CounterCheckpoint::Entry> checkpointedSeries_;		//!< Map associating keys of rate series to their checkpointed previous value, until the first collection iteration (listing available metrics keeps it)
+			std::unique_ptr<Spool> spool_;												//!< Spool keeping metrics which could not be published, if enabled
+			size_t spoolReplayBatchSize_;												//!< Minimum number of metrics given at once to the delegate when replaying the spool
+			bool publishesSnapshots_;													//!< Whether a snapshot of every series is published after each iteration
+			std::atomic<bool> emitsSelfMetrics_;										//!< Whether metrics describing the time spent in each stage of the iterations are collected
+			bool measuresRound_;														//!< Whether the current iteration is measured (the value of `emitsSelfMetrics_` when it started)
+			RoundStatistics roundStatistics_;											//!< Durations of the stages of the current iteration (of the previous one for its delivery and total duration)
+			std::shared_ptr<const MetricSnapshot> snapshot_;							//!< Latest published snapshot, only accessed through atomic operations
+			std::shared_ptr<MetricSnapshot> spareSnapshot_;								//!< Previously published snapshot, reused once no reader holds it anymore
+			std::unique_ptr<Dispatcher> dispatcher_;									//!< Dispatcher giving metrics to the delegate from a delivery thread, if enabled (declared last so that it is stopped first)
+
+			/**
+			 * @brief Replaces sources, expressions and matchers according to a config, reusing the unchanged ones
+			 *
+			 * A file or command used by several entries gets a single source, with the expressions of all entries. Sources reading the same file or running the same command as before are reused, as well as expressions configured the same way along with their matchers. Other expressions reuse the compiled regex of an expression with the same pattern. Series keep their state whatever their matcher becomes, and are handed over to the new matcher configured the same way as theirs, if any, so that budgets stay accounted.
+			 *
+			 * @param config the config to apply
+			 */
+			void applyConfig(const Config& config);
+
+			/**
+			 * @brief Applies the config loaded and the matcher filter set while collecting, if any
+			 */
+			void applyPendingConfig();
+
+			/**
+			 * @brief Enables the matchers selected by the matcher filter, the expressions with enabled matchers and the sources with enabled expressions, and disables the others
+			 */
+			void applyMatcherFilter() noexcept;
+
+			/**
+			 * @brief Reads and parses a config file, or loads it from the config cache if it was already parsed
+			 *
+			 * @param configPath the config file path
+			 * @return the config, which may be invalid
+			 */
+			std::unique_ptr<Config> readConfigFile(const std::string& configPath);
+
+			/**
+			 * @brief Reloads the config file if it is watched and was modified since it was loaded
+			 */
+			void reloadModifiedConfigFile();
+
+			/**
+			 * @brief Returns whether metrics can be collected, i.e. whether sources, expressions and matchers are configured
+			 */
+			bool canCollect() const noexcept;
+
+			/**
+			 * @brief Waits until a time point, or until the collection loop is asked to stop
+			 *
+			 * @return *true* if the collection loop should go on
+			 * @return *false* if it should stop
+			 */
+			bool waitUntil(std::chrono::system_clock::time_point deadline) noexcept;
+
+			/**
+			 * @brief Runs the collection loop until the delegate or `stop` stops it (`isCollecting_` must already be set)
+			 */
+			void runCollection() noexcept;
+
+			/**
+			 * @brief Collects an iteration: reads sources, computes values and builds the iteration's metrics, without giving them to the delegate
+			 */
+			void collectIteration() noexcept;
 
 			/**
-			 * @brief Updates sources (fetches file contents and executes commands)
+			 * @brief Updates sources (fetches file contents and executes commands) and computes their matches, one source after the other
+			 *
+			 * When a maximum collect duration is set and it is exceeded, the remaining sources are deferred to the next iteration, which starts with them so that the same sources are not always deferred.
+			 *
+			 * @param hasDeadline whether the maximum collect duration applies
+			 */
+			void collectSources(bool hasDeadline) noexcept;
+
+			/**
+			 * @brief For each line of a source, executes the source's expressions to find matches
+			 */
+			void computeMatches(const Source& source) noexcept;
+
+			/**
+			 * @brief Returns the first sampling deadline after a time point, aligned on a multiple of the sampling interval since the epoch
+			 */
+			std::chrono::system_clock::time_point nextSamplingDeadline(std::chrono::system_clock::time_point now) const noexcept;
+
+			/**
+			 * @brief Starts a collection run, whose rates are not computed from the values read before it
 			 */
-			void updateSources() noexcept;
+			void startCollectionRun() noexcept;
 
 			/**
-			 * @brief For each line of each source, executes the source's expressions to find matches
+			 * @brief Returns the factor applied to the variation of a rate series, from the time elapsed since its previous value
+			 *
+			 * Variations converted to units per second are divided by the elapsed time. Others are per sampling interval: they are scaled by the sampling interval over the elapsed time, so late or missed iterations (deadlines skipped, first aligned round, deferred or rotated sources) are brought back to one interval.
+			 *
+			 * @param index index of the series
+			 * @param timestamp timestamp of the new value
+			 * @param convertsToUnitsPerSecond whether the variation is converted to units per second
+			 * @return the factor, using the sampling interval if the elapsed time is unknown
 			 */
-			void computeMatches() noexcept;
+			double rateFactor(MetricStore::Index index, std::chrono::system_clock::time_point timestamp, bool convertsToUnitsPerSecond) const noexcept;
+
+			/**
+			 * @brief Reads the counter checkpoint once a config is applied, if it was not read yet
+			 */
+			void restoreCounterCheckpoint();
+
+			/**
+			 * @brief Writes the previous value of every rate series into the counter checkpoint, if enabled
+			 */
+			void writeCounterCheckpoint() noexcept;
+
+			/**
+			 * @brief Gives a rate series without previous value in the current run its checkpointed previous value, as if it had been read at the previous reading of its source
+			 *
+			 * @return *true* if the series was in the checkpoint
+			 * @return *false* otherwise
+			 */
+			bool restoreCheckpointedSeries(MetricStore::Index index, const Key& key) noexcept;
 
 			/**
 			 * @brief Updates metrics from a match
@@ -79,7 +268,76 @@ namespace AnyCollect {
 			 * @param match the results of the expression's matching
 			 * @param matcher the Matcher object to create a metric from
 			 */
-			void parseData(const Source& source, const std::cmatch& match, const Matcher& matcher) noexcept;
+			void parseData(const Source& source, const std::cmatch& match, Matcher& matcher) noexcept;
+
+			/**
+			 * @brief Corrects the iteration's rates of counters which went backwards (wraps and resets), according to their counter type
+			 *
+			 * This is done once all matches are parsed, since values of a series may be summed over several matches. Rates of reset counters are removed from the iteration's updated series, leaving a gap.
+			 */
+			void checkCounters() noexcept;
+
+			/**
+			 * @brief Removes from the iteration's updated series the ones whose value should not be given to the delegate, according to their emission policy
+			 */
+			void filterUpdatedSeries() noexcept;
+
+			/**
+			 * @brief Sets the value of a metric describing the controller itself, and adds it to the iteration's updated metrics
+			 *
+			 * @param name name of the metric, after `internalMetricPrefix`
+			 * @param tags tags of the metric
+			 * @param value value of the metric
+			 */
+			void setInternalMetric(const std::vector<std::string>& name, const std::map<std::string, std::string>& tags, double value) noexcept;
+
+			/**
+			 * @brief Inserts a new series in the store, locking it against `history` queries
+			 *
+			 * @param identity identity of the series
+			 * @param owner matcher which created the series, if any
+			 * @return the index of the series
+			 */
+			MetricStore::Index insertSeries(std::shared_ptr<const Metric::Identity> identity, Matcher* owner = nullptr);
+
+			/**
+			 * @brief Updates the metrics describing the controller itself
+			 */
+			void updateInternalMetrics() noexcept;
+
+			/**
+			 * @brief Updates the metrics describing the time spent in each stage of the iteration, and resets the statistics of sources, expressions and matchers
+			 */
+			void updateSelfMetrics() noexcept;
+
+			/**
+			 * @brief Builds the iteration's metric objects from the updated series, and the array of pointers given to the delegate
+			 */
+			void publishUpdatedMetrics() noexcept;
+
+			/**
+			 * @brief Gives the iteration's metrics to the delegate, or spools them if the delegate cannot publish them
+			 *
+			 * Spooled metrics are replayed to the delegate before any new metrics, once it can publish again.
+			 */
+			void deliverUpdatedMetrics() noexcept;
+
+			/**
+			 * @brief Publishes a snapshot of every series, if enabled
+			 *
+			 * The snapshot replaced by the new one is kept, and its storage reused at the next iteration if no reader still holds it.
+			 */
+			void publishSnapshot();
+
+			/**
+			 * @brief Appends the iteration's updated values to the history of their series
+			 */
+			void recordHistory() noexcept;
+
+			/**
+			 * @brief Evicts series which were not updated for more than `staleSeriesThreshold_` rounds and compacts the store, if it is time to
+			 */
+			void evictStaleSeries() noexcept;
 
 		public:
 			/**
@@ -89,6 +347,11 @@ namespace AnyCollect {
 			 */
 			Controller(ControllerDelegate& delegate) noexcept;
 
+			/**
+			 * @brief Destroy the Controller object, stopping and joining its collection thread if any
+			 */
+			~Controller();
+
 
 			/**
 			 * @brief Returns the controller's delegate
@@ -104,33 +367,327 @@ namespace AnyCollect {
 			/**
 			 * @brief Returns the metrics sampling interval
 			 */
-			std::chrono::seconds samplingInterval() const noexcept;
+			std::chrono::milliseconds samplingInterval() const noexcept;
+
+			/**
+			 * @brief Returns the number of collection iterations skipped so far because the previous ones ran past their deadline
+			 */
+			size_t missedRoundCount() const noexcept;
+
+			/**
+			 * @brief Returns the number of counter resets detected in a series (0 if the series is unknown)
+			 */
+			size_t counterResetCount(const Key& key) const noexcept;
+
+			/**
+			 * @brief Returns the number of values not given to the delegate so far because of emission policies
+			 */
+			size_t suppressedValueCount() const noexcept;
+
+			/**
+			 * @brief Returns whether series identities are compared when their keys match
+			 */
+			bool verifiesKeys() const noexcept;
+
+			/**
+			 * @brief Returns the number of key collisions detected so far (only counted when keys are verified)
+			 */
+			size_t keyCollisionCount() const noexcept;
+
+			/**
+			 * @brief Returns the number of rounds without update after which a series is evicted (0 if series are never evicted)
+			 */
+			size_t staleSeriesThreshold() const noexcept;
+
+			/**
+			 * @brief Returns the number of rounds between two stale series evictions
+			 */
+			size_t compactionInterval() const noexcept;
+
+			/**
+			 * @brief Returns the number of series currently stored
+			 */
+			size_t seriesCount() const noexcept;
+
+			/**
+			 * @brief Returns the number of series evicted so far
+			 */
+			size_t evictedSeriesCount() const noexcept;
+
+			/**
+			 * @brief Returns the maximum time spent reading sources in an iteration (0 for no limit)
+			 */
+			std::chrono::milliseconds maxCollectDuration() const noexcept;
+
+			/**
+			 * @brief Returns the number of source readings deferred so far because of the maximum collect duration
+			 */
+			size_t deferredSourceCount() const noexcept;
+
+			/**
+			 * @brief Returns the maximum number of series created by matchers (0 for no limit)
+			 */
+			size_t maxSeries() const noexcept;
+
+			/**
+			 * @brief Returns the number of distinct new series rejected because of exhausted budgets since the config was applied
+			 *
+			 * A rejected series is counted once however many samples of it are dropped. At most `maxTrackedRejectedSeries` series are counted.
+			 */
+			size_t rejectedSeriesCount() const noexcept;
+
+			/**
+			 * @brief Returns the resolutions of the history kept for every series (empty if history is disabled)
+			 */
+			std::vector<SeriesHistory::Resolution> historyResolutions() const noexcept;
+
+			/**
+			 * @brief Returns the recent history of a series within a time range, oldest first
+			 *
+			 * This can be called from any thread, at any time: the query locks the series store, which the collector also locks when it adds or evicts series and records history. A query thus briefly delays the collection iteration, and should cover reasonable time ranges.
+			 *
+			 * @param key key of the series
+			 * @param from beginning of the time range (included)
+			 * @param to end of the time range (included)
+			 * @param interval requested resolution: the coarsest history level whose interval is not larger is used (0 for raw values)
+			 * @return the points of the series in the time range (empty if the series is unknown or history is disabled)
+			 */
+			std::vector<SeriesHistory::Point> history(const Key& key, std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to, std::chrono::seconds interval = 0s) const;
+
+			/**
+			 * @brief Returns whether a snapshot of every series is published after each iteration
+			 */
+			bool publishesSnapshots() const noexcept;
+
+			/**
+			 * @brief Returns whether metrics describing the time spent in each stage of the iterations are collected
+			 */
+			bool emitsSelfMetrics() const noexcept;
+
+			/**
+			 * @brief Returns the latest published snapshot of every series
+			 *
+			 * This can be called from any thread, at any time, without waiting for a collection iteration: the snapshot is never modified once published, and stays valid as long as it is held. The pointer is swapped with the `std::atomic_load` and `std::atomic_exchange` overloads for `std::shared_ptr`, which are not lock-free (the standard library guards them with a small pool of mutexes): a call may briefly wait for the exchange publishing the next snapshot, but never for the copy of the series.
+			 *
+			 * @return the latest snapshot, or null if none was published yet
+			 */
+			std::shared_ptr<const MetricSnapshot> snapshot() const noexcept;
+
+			/**
+			 * @brief Returns the maximum number of iterations queued for the delivery thread (0 if metrics are given to the delegate directly)
+			 */
+			size_t dispatchQueueSize() const noexcept;
+
+			/**
+			 * @brief Returns the number of iterations queued for the delivery thread and not delivered yet
+			 */
+			size_t dispatchQueueDepth() const noexcept;
+
+			/**
+			 * @brief Returns the time the delivery thread took to give the last iteration to the delegate, since it was queued
+			 */
+			std::chrono::microseconds dispatchLatency() const noexcept;
+
+			/**
+			 * @brief Returns the number of iterations dropped or coalesced so far because the delivery thread fell behind
+			 */
+			size_t overflowedDispatchCount() const noexcept;
+
+			/**
+			 * @brief Returns the number of collection iterations spooled and waiting to be published
+			 */
+			size_t spooledRoundCount() const noexcept;
+
+			/**
+			 * @brief Returns the number of spooled collection iterations lost because of disk limits or errors
+			 */
+			size_t droppedSpooledRoundCount() const noexcept;
+
+
+			/**
+			 * @brief Returns whether the config file is reloaded when it is modified
+			 */
+			bool watchesConfigFile() const noexcept;
+
+			/**
+			 * @brief Returns the path of the binary config cache (empty if disabled)
+			 */
+			const std::string& configCachePath() const noexcept;
+
+			/**
+			 * @brief Returns the path of the counter checkpoint (empty if disabled)
+			 */
+			std::string counterCheckpointPath() const noexcept;
 
 
 			/**
 			 * @brief Configures sources, expressions and matchers according to config file
 			 *
+			 * Loading a config again only replaces what changed, so that series keep their state (e.g. the previous value of rates) and no iteration is lost. This can be called from any thread while collecting (for instance from the delegate's callbacks, when a reload is requested): the config is then handed over to the collector thread and applied at the beginning of the next iteration. An invalid config is reported and ignored, unless no config was loaded yet, in which case the program's execution is aborted. Once a config was loaded, an empty file (e.g. truncated or caught while being written) is treated as invalid.
+			 *
 			 * @param configPath the config file path
+			 * @return *true* if the config was loaded
+			 * @return *false* if it is invalid
 			 */
-			void loadConfigFromFile(const std::string& configPath);
+			bool loadConfigFromFile(const std::string& configPath);
+
+			/**
+			 * @brief Sets whether the config file is reloaded when it is modified (checked at each iteration, disabled by default)
+			 */
+			void setWatchesConfigFile(bool watchesConfigFile) noexcept;
+
+			/**
+			 * @brief Sets the path of the binary config cache (empty to disable it, which is the default), before loading a config
+			 *
+			 * Configs are then parsed once: while the contents of the config file do not change, the parsed config is loaded from the cache file instead, which is much faster for large configs. Regexes are still compiled when loading a config.
+			 */
+			void setConfigCachePath(const std::string& cachePath);
+
+			/**
+			 * @brief Sets the path of the counter checkpoint (empty to disable it, which is the default), before collecting
+			 *
+			 * The previous value of every rate series is then written to this memory-mapped file at each iteration. After a restart, series found in the checkpoint compute their rate from the first reading instead of waiting for a second one, and `collectMetrics` delivers that first reading immediately. The checkpoint is ignored if it was written during another boot of the machine or with another config.
+			 */
+			void setCounterCheckpointPath(const std::string& checkpointPath);
 
 			/**
 			 * @brief Sets the metrics sampling interval
+			 *
+			 * Iterations are scheduled on multiples of the interval since the epoch, so that several collectors sample at the same instants. Rates are converted to units per second with the time actually elapsed between two readings of a source.
 			 */
-			void setSamplingInterval(std::chrono::seconds interval) noexcept;
+			void setSamplingInterval(std::chrono::milliseconds interval) noexcept;
+
+			/**
+			 * @brief Sets whether series identities (name and tags) are compared when their keys match
+			 *
+			 * When enabled, a sample whose key matches an existing series with a different identity is dropped and counted as a collision instead of being merged into that series.
+			 */
+			void setVerifiesKeys(bool verifiesKeys) noexcept;
+
+			/**
+			 * @brief Sets the number of rounds without update after which a series is evicted (0 to never evict)
+			 */
+			void setStaleSeriesThreshold(size_t rounds) noexcept;
+
+			/**
+			 * @brief Sets the number of rounds between two stale series evictions (at least 1)
+			 */
+			void setCompactionInterval(size_t rounds) noexcept;
+
+			/**
+			 * @brief Sets the maximum time spent reading sources and matching their contents in an iteration (0 for no limit, which is the default)
+			 *
+			 * Once it is exceeded, the sources not read yet are deferred to the next iteration, which starts with them. A source is never interrupted, so an iteration may exceed the duration by the time taken by one source. Deferred readings are counted per source in the `anycollect/sources/deferred` metric.
+			 */
+			void setMaxCollectDuration(std::chrono::milliseconds duration) noexcept;
+
+			/**
+			 * @brief Sets a predicate selecting the matchers to evaluate, when only some metrics are wanted (empty to evaluate all of them, which is the default)
+			 *
+			 * Matchers not selected are skipped, as are the expressions without selected matchers and the sources without such expressions: they are neither read nor matched. The predicate is given each matcher whenever a config is applied, and should be conservative, since it only knows the matcher's patterns. The series of disabled matchers are not updated anymore, and are evicted like other stale series. When collecting, the predicate is applied at the beginning of the next iteration.
+			 */
+			void setMatcherFilter(std::function<bool(const Matcher&)> filter);
+
+			/**
+			 * @brief Sets the maximum number of series created by matchers, all matchers included (0 for no limit)
+			 *
+			 * Internal metrics and overflow series do not count against the limit. Once it is reached, samples of new series are dropped or folded into their matcher's overflow series, according to the matcher's overflow policy.
+			 */
+			void setMaxSeries(size_t maxSeries) noexcept;
+
+			/**
+			 * @brief Sets the resolutions of the history kept for every series, dropping any recorded history
+			 *
+			 * A level with a null interval keeps the raw values collected at each iteration, the other ones keep rollups (minimum, maximum, average and last value) over buckets of their interval.
+			 *
+			 * @param resolutions the history levels (empty to disable history, which is the default)
+			 */
+			void setHistoryResolutions(std::vector<SeriesHistory::Resolution> resolutions);
+
+			/**
+			 * @brief Enables the spool, which keeps on disk the metrics the delegate cannot publish, until it can again
+			 *
+			 * Rounds left in the directory by a previous process are replayed too.
+			 *
+			 * @param directory directory holding the spool files (empty to disable the spool, which is the default)
+			 * @param maxSize maximum disk space used by the spool, in bytes; the oldest metrics are dropped beyond it
+			 * @param segmentSize size of each spool file, in bytes
+			 */
+			void setSpool(const std::string& directory, size_t maxSize, size_t segmentSize = Controller::defaultSpoolSegmentSize);
+
+			/**
+			 * @brief Sets the minimum number of metrics given at once to the delegate when replaying the spool
+			 */
+			void setSpoolReplayBatchSize(size_t batchSize) noexcept;
+
+
+			/**
+			 * @brief Enables the delivery thread, which gives metrics to the delegate while the next iteration is collected
+			 *
+			 * Each iteration's metrics are queued for the delivery thread, so that a slow delegate does not delay sampling. The delegate's `contollerCollectedMetrics` and `contollerEvictedMetrics` are then called from the delivery thread, in order, and must not use the controller other than through thread-safe functions (such as `snapshot`). Queued metrics are all delivered before `collectMetrics` returns.
+			 *
+			 * @param queueSize maximum number of queued iterations, rounded up to a power of two (0 to give metrics to the delegate directly, which is the default)
+			 * @param overflowPolicy what to do with an iteration when the queue is full
+			 */
+			void setDispatchQueue(size_t queueSize, Dispatcher::OverflowPolicy overflowPolicy = Dispatcher::OverflowBlock);
+
+			/**
+			 * @brief Sets whether a snapshot of every series is published after each iteration (disabled by default)
+			 *
+			 * Snapshots let other threads read the latest values while the controller is collecting (see `snapshot`). Publishing one costs a copy of every series per iteration.
+			 */
+			void setPublishesSnapshots(bool publishesSnapshots) noexcept;
+
+			/**
+			 * @brief Sets whether metrics describing the time spent in each stage of the iterations are collected (disabled by default)
+			 *
+			 * They are given to the delegate with the other metrics, under `anycollect/self`: durations of the iteration's stages (`round/read_us`, `match_us`, `delivery_us` and `duration_us`, the last two being those of the previous iteration), number of series (`series`), reading duration and size of each source (`source/read_us` and `bytes`), number of lines each regex was applied on and matched and the time it took (`expression/attempts`, `matches` and `match_us`), and number of matches from which a matcher could not compute a metric (`matcher/failures`). Values are counted during each iteration by the collecting thread, without synchronization, and reported once at its end. This can be called from any thread while collecting: it takes effect at the beginning of the next iteration.
+			 */
+			void setEmitsSelfMetrics(bool emitsSelfMetrics) noexcept;
 
 
 			/**
 			 * @brief Returns the array of all currently matching metrics on the system, without their values
 			 *
+			 * This returns nothing while the controller is collecting: use `snapshot` instead. Returned pointers are valid until the next call to `availableMetrics` or `collectMetrics`.
+			 *
 			 * @return metrics currently available on the system
 			 */
 			std::vector<const Metric*> availableMetrics() noexcept;
 
 			/**
-			 * @brief Launch metric collection loop
+			 * @brief Launch metric collection loop, returning once it is stopped by the delegate or by `stop`
 			 */
 			void collectMetrics() noexcept;
+
+			/**
+			 * @brief Launch metric collection loop on a thread owned by the controller
+			 *
+			 * @return *true* if the thread was started
+			 * @return *false* if the controller is already collecting metrics or is not configured
+			 */
+			bool start();
+
+			/**
+			 * @brief Asks the collection loop to stop, without waiting for it
+			 *
+			 * A loop waiting for its next iteration is woken up at once. This can be called from any thread, including the delegate's callbacks.
+			 */
+			void stop() noexcept;
+
+			/**
+			 * @brief Waits for the collection thread started with `start` to end
+			 */
+			void join();
+
+			/**
+			 * @brief Collects a single iteration of metrics and returns them, instead of giving them to the delegate
+			 *
+			 * This lets embedders pull metrics at their own pace, without the collection loop. As with the loop, rates need two iterations to be computed. Returned pointers are valid until the next call to `availableMetrics` or `collectOnce`.
+			 *
+			 * @return the iteration's metrics, or nothing if the controller is already collecting metrics or is not configured
+			 */
+			std::vector<const Metric*> collectOnce() noexcept;
 	};
 
 
@@ -157,5 +714,24 @@ namespace AnyCollect {
 			 * @return *false* otherwise
 			 */
 			virtual bool contollerShouldStopCollectingMetrics(const Controller& controller) = 0;
+
+			/**
+			 * @brief Function called when the Controller has evicted stale series
+			 *
+			 * @param controller the calling Controller
+			 * @param keys keys of the evicted series
+			 */
+			virtual void contollerEvictedMetrics(const Controller& controller, const std::vector<Key>& keys);
+
+			/**
+			 * @brief Function called before giving metrics to the delegate, when the spool is enabled, to ask whether they can be published
+			 *
+			 * When it returns *false*, the metrics are spooled instead, and replayed once it returns *true* again.
+			 *
+			 * @param controller the calling Controller
+			 * @return *true* if metrics can be published (default)
+			 * @return *false* otherwise
+			 */
+			virtual bool contollerCanPublishMetrics(const Controller& controller);
 	};
 }
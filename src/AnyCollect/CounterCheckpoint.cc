@@ -0,0 +1,132 @@
+//
+// CounterCheckpoint.cc
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CounterCheckpoint.h"
+#include "Source.h"
+
+
+namespace AnyCollect {
+	CounterCheckpoint::CounterCheckpoint(const std::string& path, int fd, uint8_t* data, size_t size) noexcept :
+		path_(path),
+		fd_(fd),
+		data_(data),
+		size_(size)
+	{ }
+
+	Key CounterCheckpoint::bootId() noexcept {
+		static const Key bootId = [] {
+			Source bootIdFile{"/proc/sys/kernel/random/boot_id"};
+			bootIdFile.update();
+			return bootIdFile.contents().empty() ? Key{0, 0} : Hasher::hash(bootIdFile.contents());
+		}();
+		return bootId;
+	}
+
+	std::unique_ptr<CounterCheckpoint> CounterCheckpoint::open(const std::string& path) noexcept {
+		int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0) {
+			perror(std::string(path).append(": Error opening counter checkpoint").c_str());
+			return nullptr;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			perror(std::string(path).append(": Error opening counter checkpoint").c_str());
+			::close(fd);
+			return nullptr;
+		}
+
+		// A file too small to hold a header (such as a new one) is reset
+		size_t size = st.st_size;
+		if (size < sizeof(Header)) {
+			size = sizeof(Header);
+			if (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0) {
+				perror(std::string(path).append(": Error allocating counter checkpoint").c_str());
+				::close(fd);
+				return nullptr;
+			}
+		}
+		void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) {
+			perror(std::string(path).append(": Error mapping counter checkpoint").c_str());
+			::close(fd);
+			return nullptr;
+		}
+		return std::unique_ptr<CounterCheckpoint>{new CounterCheckpoint(path, fd, static_cast<uint8_t*>(data), size)};
+	}
+
+	CounterCheckpoint::~CounterCheckpoint() {
+		if (this->data_ != nullptr)
+			munmap(this->data_, this->size_);
+		if (this->fd_ >= 0)
+			::close(this->fd_);
+	}
+
+
+	const std::string& CounterCheckpoint::path() const noexcept {
+		return this->path_;
+	}
+
+	bool CounterCheckpoint::reserve(size_t count) noexcept {
+		if (count <= this->capacity())
+			return true;
+
+		// Grow geometrically, so that the file is only remapped a few times while series are discovered
+		size_t size = sizeof(Header) + std::max(count, 2 * this->capacity()) * sizeof(Entry);
+		if (ftruncate(this->fd_, size) != 0) {
+			perror(std::string(this->path_).append(": Error allocating counter checkpoint").c_str());
+			return false;
+		}
+		void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd_, 0);
+		if (data == MAP_FAILED) {
+			perror(std::string(this->path_).append(": Error mapping counter checkpoint").c_str());
+			return false;
+		}
+		munmap(this->data_, this->size_);
+		this->data_ = static_cast<uint8_t*>(data);
+		this->size_ = size;
+		return true;
+	}
+
+	std::vector<CounterCheckpoint::Entry> CounterCheckpoint::read(const Key& configHash) const {
+		const Header& header = this->header();
+		if (header.magic != CounterCheckpoint::magic || header.bootId != CounterCheckpoint::bootId() || header.configHash != configHash || header.entryCount > this->capacity())
+			return {};
+		const Entry* entries = reinterpret_cast<const Entry*>(this->data_ + sizeof(Header));
+		return std::vector<Entry>(entries, entries + header.entryCount);
+	}
+
+	CounterCheckpoint::Entry* CounterCheckpoint::entries(size_t count) noexcept {
+		this->header().magic = 0;
+		if (!this->reserve(count))
+			return nullptr;
+		return reinterpret_cast<Entry*>(this->data_ + sizeof(Header));
+	}
+
+	void CounterCheckpoint::commit(const Key& configHash, size_t count) noexcept {
+		this->header() = Header{CounterCheckpoint::magic, CounterCheckpoint::bootId(), configHash, count};
+	}
+}
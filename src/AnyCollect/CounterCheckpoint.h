@@ -0,0 +1,149 @@
+//
+// CounterCheckpoint.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Hash.h"
+
+
+namespace AnyCollect {
+	/**
+	 * @brief Class used to persist the previous values of rate series in a memory-mapped file, so that rates can be computed from the first round after a restart
+	 *
+	 * The file starts with a header holding the boot identifier of the machine and the hash of the config the entries were collected with, followed by one fixed-size entry per series. A checkpoint written during another boot (counters of the kernel start again from zero) or with another config is ignored.
+	 *
+	 * Entries are written in place into the mapping every round, without any system call, and left to the kernel to write back: they survive a restart of the process, and the boot identifier invalidates them when the machine stops before they reach the disk.
+	 */
+	class CounterCheckpoint {
+		public:
+			static constexpr uint64_t magic = 0x313054504b434341;						//!< Magic number of checkpoint files ("ACCKPT01")
+
+			/**
+			 * @brief Previous value of a series
+			 */
+			struct Entry {
+				Key key;																//!< Key of the series
+				double previousValue;													//!< Value last read for the series
+				int64_t timestamp;														//!< Time the value was read at (in nanoseconds since the epoch)
+			};
+
+		protected:
+			/**
+			 * @brief Header at the beginning of a checkpoint file
+			 */
+			struct Header {
+				uint64_t magic;															//!< Magic number (`CounterCheckpoint::magic`)
+				Key bootId;																//!< Hash of the boot identifier of the machine
+				Key configHash;															//!< Hash of the JSON contents of the config
+				uint64_t entryCount;													//!< Number of entries after the header
+			};
+
+			std::string path_;															//!< Path of the checkpoint file
+			int fd_;																	//!< File descriptor of the checkpoint file
+			uint8_t* data_;																//!< Mapped contents of the checkpoint file
+			size_t size_;																//!< Size of the checkpoint file
+
+			/**
+			 * @brief Construct a new CounterCheckpoint object from an opened file
+			 */
+			CounterCheckpoint(const std::string& path, int fd, uint8_t* data, size_t size) noexcept;
+
+			/**
+			 * @brief Returns the header of the checkpoint
+			 */
+			Header& header() const noexcept {
+				return *reinterpret_cast<Header*>(this->data_);
+			}
+
+			/**
+			 * @brief Returns the number of entries the file can hold
+			 */
+			size_t capacity() const noexcept {
+				return (this->size_ - sizeof(Header)) / sizeof(Entry);
+			}
+
+			/**
+			 * @brief Grows the file so that it can hold at least the given number of entries
+			 *
+			 * @return *true* if the file can hold the entries
+			 * @return *false* otherwise
+			 */
+			bool reserve(size_t count) noexcept;
+
+		public:
+			/**
+			 * @brief Returns the hash of the boot identifier of the machine (null if it is unknown)
+			 */
+			static Key bootId() noexcept;
+
+			/**
+			 * @brief Opens a checkpoint file, creating it if it does not exist
+			 *
+			 * @param path path of the file
+			 * @return the checkpoint, or null if the file could not be opened
+			 */
+			static std::unique_ptr<CounterCheckpoint> open(const std::string& path) noexcept;
+
+			/**
+			 * @brief Destroy the CounterCheckpoint object, unmapping its file
+			 */
+			~CounterCheckpoint();
+
+			CounterCheckpoint(const CounterCheckpoint&) = delete;
+			CounterCheckpoint& operator=(const CounterCheckpoint&) = delete;
+
+
+			/**
+			 * @brief Returns the path of the checkpoint file
+			 */
+			const std::string& path() const noexcept;
+
+			/**
+			 * @brief Returns the entries of the checkpoint, if they were written during the current boot with the given config
+			 *
+			 * @param configHash hash of the JSON contents of the current config
+			 * @return the entries, or nothing if the checkpoint is stale
+			 */
+			std::vector<Entry> read(const Key& configHash) const;
+
+			/**
+			 * @brief Returns space for entries to be written in place, to be committed with `commit`
+			 *
+			 * The header is invalidated until `commit` is called, so that a process stopped while writing leaves no partial checkpoint.
+			 *
+			 * @param count maximum number of entries to write
+			 * @return the entries, or null if the file could not grow
+			 */
+			Entry* entries(size_t count) noexcept;
+
+			/**
+			 * @brief Validates entries written in place
+			 *
+			 * @param configHash hash of the JSON contents of the config the entries were collected with
+			 * @param count number of entries written
+			 */
+			void commit(const Key& configHash, size_t count) noexcept;
+	};
+}
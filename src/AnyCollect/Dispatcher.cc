@@ -0,0 +1,256 @@
+//
+// Dispatcher.cc
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+
+#include "Controller.h"
+#include "Dispatcher.h"
+
+
+namespace AnyCollect {
+	Dispatcher::Dispatcher(Controller& controller, ControllerDelegate& delegate, size_t capacity, OverflowPolicy overflowPolicy) :
+		controller_(controller),
+		delegate_(delegate),
+		overflowPolicy_(overflowPolicy),
+		queue_(std::max<size_t>(capacity, 1)),
+		freeMetrics_(std::max<size_t>(capacity, 1) + 2),
+		hasPendingBatch_(false),
+		pendingCount_(0),
+		publishedCount_(0),
+		droppedBatchCount_(0),
+		coalescedBatchCount_(0),
+		lastDeliveryLatency_(0),
+		maxDeliveryLatency_(0),
+		isStopping_(false)
+	{
+		this->thread_ = std::thread(&Dispatcher::run, this);
+	}
+
+	Dispatcher::~Dispatcher() {
+		this->flush();
+		{
+			std::lock_guard<std::mutex> lock(this->mutex_);
+			this->isStopping_ = true;
+		}
+		this->consumerCondition_.notify_one();
+		this->thread_.join();
+	}
+
+
+	size_t Dispatcher::capacity() const noexcept {
+		return this->queue_.capacity();
+	}
+
+	Dispatcher::OverflowPolicy Dispatcher::overflowPolicy() const noexcept {
+		return this->overflowPolicy_;
+	}
+
+	size_t Dispatcher::queueDepth() const noexcept {
+		return this->pendingCount_.load(std::memory_order_relaxed);
+	}
+
+	size_t Dispatcher::droppedBatchCount() const noexcept {
+		return this->droppedBatchCount_.load(std::memory_order_relaxed);
+	}
+
+	size_t Dispatcher::coalescedBatchCount() const noexcept {
+		return this->coalescedBatchCount_.load(std::memory_order_relaxed);
+	}
+
+	std::chrono::microseconds Dispatcher::lastDeliveryLatency() const noexcept {
+		return std::chrono::microseconds(this->lastDeliveryLatency_.load(std::memory_order_relaxed));
+	}
+
+	std::chrono::microseconds Dispatcher::maxDeliveryLatency() const noexcept {
+		return std::chrono::microseconds(this->maxDeliveryLatency_.load(std::memory_order_relaxed));
+	}
+
+
+	void Dispatcher::dispatchMetrics(std::vector<Metric>& metrics) {
+		Batch batch;
+		batch.metrics.swap(metrics);
+		if (!this->freeMetrics_.tryPop(metrics))
+			metrics.clear();
+		this->enqueue(std::move(batch));
+	}
+
+	void Dispatcher::dispatchEvictedKeys(std::vector<Key>&& keys) {
+		Batch batch;
+		batch.evictedKeys = std::move(keys);
+		this->enqueue(std::move(batch));
+	}
+
+	void Dispatcher::flush() {
+		std::unique_lock<std::mutex> lock(this->mutex_);
+		while (!this->pushPendingBatch())
+			this->producerCondition_.wait(lock);
+		this->producerCondition_.wait(lock, [&] {
+			return this->pendingCount_.load() == 0;
+		});
+	}
+
+
+	void Dispatcher::enqueue(Batch&& batch) {
+		batch.time = std::chrono::steady_clock::now();
+		if (this->overflowPolicy_ == Dispatcher::OverflowCoalesce) {
+			std::unique_lock<std::mutex> lock(this->mutex_);
+			if (this->hasPendingBatch_) {
+				// The queue was full: merge the batch into the pending one, which the delivery thread queues once it frees a slot
+				this->coalesce(std::move(batch));
+				return;
+			}
+			this->pendingCount_++;
+			if (!this->queue_.tryPush(batch)) {
+				this->pendingCount_--;
+				this->pendingBatch_ = std::move(batch);
+				for (size_t i = 0; i < this->pendingBatch_.metrics.size(); i++)
+					this->pendingIndexes_[this->pendingBatch_.metrics[i].key()] = i;
+				this->hasPendingBatch_ = true;
+				return;
+			}
+			lock.unlock();
+			this->notifyConsumer();
+			return;
+		}
+
+		this->pendingCount_++;
+		while (!this->queue_.tryPush(batch)) {
+			if (this->overflowPolicy_ == Dispatcher::OverflowBlock) {
+				// Batches being delivered were already popped: there is room once at most `capacity` batches, this one included, are pending
+				std::unique_lock<std::mutex> lock(this->mutex_);
+				this->producerCondition_.wait(lock, [&] {
+					return this->pendingCount_.load() <= this->queue_.capacity();
+				});
+			} else {
+				Batch dropped;
+				if (this->queue_.tryPop(dropped)) {
+					// Evictions must still reach the delegate, before the metrics of the new batch
+					batch.evictedKeys.insert(batch.evictedKeys.begin(), dropped.evictedKeys.begin(), dropped.evictedKeys.end());
+					dropped.metrics.clear();
+					this->freeMetrics_.tryPush(dropped.metrics);
+					this->droppedBatchCount_++;
+					this->pendingCount_--;
+				}
+			}
+		}
+		this->notifyConsumer();
+	}
+
+	bool Dispatcher::pushPendingBatch() {
+		if (!this->hasPendingBatch_)
+			return true;
+		this->pendingCount_++;
+		if (!this->queue_.tryPush(this->pendingBatch_)) {
+			this->pendingCount_--;
+			return false;
+		}
+		this->pendingBatch_ = Batch{};
+		this->pendingIndexes_.clear();
+		this->hasPendingBatch_ = false;
+		this->publishedCount_++;
+		this->consumerCondition_.notify_one();
+		return true;
+	}
+
+	void Dispatcher::coalesce(Batch&& batch) {
+		auto& pending = this->pendingBatch_;
+		for (const auto& key : batch.evictedKeys) {
+			// The delegate gets evictions before metrics, so an evicted series must not keep an older metric
+			auto itr = this->pendingIndexes_.find(key);
+			if (itr != this->pendingIndexes_.end()) {
+				size_t index = itr->second;
+				this->pendingIndexes_.erase(itr);
+				if (index != pending.metrics.size() - 1) {
+					pending.metrics[index] = std::move(pending.metrics.back());
+					this->pendingIndexes_[pending.metrics[index].key()] = index;
+				}
+				pending.metrics.pop_back();
+			}
+			pending.evictedKeys.push_back(key);
+		}
+		for (auto& metric : batch.metrics) {
+			auto [itr, isNew] = this->pendingIndexes_.try_emplace(metric.key(), pending.metrics.size());
+			if (isNew)
+				pending.metrics.push_back(std::move(metric));
+			else
+				pending.metrics[itr->second] = std::move(metric);
+		}
+		batch.metrics.clear();
+		this->freeMetrics_.tryPush(batch.metrics);
+		this->coalescedBatchCount_++;
+	}
+
+	void Dispatcher::notifyConsumer() noexcept {
+		// Counting the batch under the mutex ensures the delivery thread is either before reading the count or waiting
+		{
+			std::lock_guard<std::mutex> lock(this->mutex_);
+			this->publishedCount_++;
+		}
+		this->consumerCondition_.notify_one();
+	}
+
+	void Dispatcher::run() noexcept {
+		Batch batch;
+		std::vector<const Metric*> metrics;
+		size_t publishedCount = 0;
+		while (true) {
+			if (!this->queue_.tryPop(batch)) {
+				// Every batch counted in `publishedCount` can be popped: only sleep until another one is published, rather than while slots are being written
+				std::unique_lock<std::mutex> lock(this->mutex_);
+				if (this->isStopping_)
+					return;
+				this->consumerCondition_.wait(lock, [&] {
+					return this->isStopping_ || this->publishedCount_ != publishedCount;
+				});
+				publishedCount = this->publishedCount_;
+				continue;
+			}
+
+			// A slot was just freed: queue the batch kept aside while the queue was full, rather than waiting for the next one
+			if (this->overflowPolicy_ == Dispatcher::OverflowCoalesce) {
+				std::lock_guard<std::mutex> lock(this->mutex_);
+				this->pushPendingBatch();
+			}
+
+			if (!batch.evictedKeys.empty())
+				this->delegate_.contollerEvictedMetrics(this->controller_, batch.evictedKeys);
+			if (!batch.metrics.empty() || batch.evictedKeys.empty()) {
+				metrics.clear();
+				for (const auto& metric : batch.metrics)
+					metrics.push_back(&metric);
+				this->delegate_.contollerCollectedMetrics(this->controller_, metrics);
+			}
+
+			auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - batch.time).count();
+			this->lastDeliveryLatency_.store(latency, std::memory_order_relaxed);
+			if (latency > this->maxDeliveryLatency_.load(std::memory_order_relaxed))
+				this->maxDeliveryLatency_.store(latency, std::memory_order_relaxed);
+
+			batch.evictedKeys.clear();
+			batch.metrics.clear();
+			this->freeMetrics_.tryPush(batch.metrics);
+			{
+				std::lock_guard<std::mutex> lock(this->mutex_);
+				this->pendingCount_--;
+			}
+			this->producerCondition_.notify_all();
+		}
+	}
+}
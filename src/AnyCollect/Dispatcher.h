@@ -0,0 +1,196 @@
+//
+// Dispatcher.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "Hash.h"
+#include "Metric.h"
+
+using namespace std::literals;
+
+
+namespace AnyCollect {
+	class Controller;
+	class ControllerDelegate;
+
+	/**
+	 * @brief Class used to give collected metrics to the controller's delegate from a delivery thread
+	 *
+	 * Each iteration's metrics (and evicted series keys) are queued as a batch in a bounded lock-free queue, so that collecting the next iteration overlaps with delivering the previous one. When the delivery thread falls behind and the queue is full, the overflow policy tells whether to wait, to drop the oldest batch or to coalesce new batches into a single one.
+	 */
+	class Dispatcher {
+		public:
+			/**
+			 * @brief What to do with a batch when the queue is full
+			 */
+			enum OverflowPolicy {
+				OverflowBlock,				//!< Wait for the delivery thread to make room, delaying collection
+				OverflowDropOldest,			//!< Drop the oldest queued batch (its evicted series keys are kept)
+				OverflowCoalesce,			//!< Keep the batch aside and merge the next ones into it, keeping the latest metric of each series, until there is room
+			};
+			static constexpr std::string_view overflowBlockString = "Block"sv;				//!< Configuration string of `OverflowBlock`
+			static constexpr std::string_view overflowDropOldestString = "DropOldest"sv;	//!< Configuration string of `OverflowDropOldest`
+			static constexpr std::string_view overflowCoalesceString = "Coalesce"sv;		//!< Configuration string of `OverflowCoalesce`
+
+		protected:
+			/**
+			 * @brief Metrics and evicted series keys to give to the delegate together (evictions first)
+			 */
+			struct Batch {
+				std::vector<Key> evictedKeys;										//!< Keys of the evicted series
+				std::vector<Metric> metrics;										//!< Collected metrics
+				std::chrono::steady_clock::time_point time;							//!< Time the batch was queued at
+			};
+
+			Controller& controller_;												//!< Controller whose metrics are dispatched
+			ControllerDelegate& delegate_;											//!< Delegate to give metrics to
+			OverflowPolicy overflowPolicy_;											//!< What to do with a batch when the queue is full
+			BoundedQueue<Batch> queue_;												//!< Batches waiting to be delivered
+			BoundedQueue<std::vector<Metric>> freeMetrics_;							//!< Delivered metric arrays, kept to reuse their storage
+			Batch pendingBatch_;													//!< Batch kept aside while the queue is full, queued by the delivery thread as soon as it frees a slot (coalesce policy only, protected by `mutex_`)
+			bool hasPendingBatch_;													//!< Whether `pendingBatch_` holds a batch (protected by `mutex_`)
+			std::unordered_map<Key, size_t> pendingIndexes_;						//!< Map associating series keys to their index in `pendingBatch_` (protected by `mutex_`)
+			std::atomic<size_t> pendingCount_;										//!< Number of batches queued and not delivered yet
+			size_t publishedCount_;													//!< Number of batches pushed to the queue so far, counted once they can be popped (protected by `mutex_`)
+			std::atomic<size_t> droppedBatchCount_;									//!< Number of batches dropped because the queue was full
+			std::atomic<size_t> coalescedBatchCount_;								//!< Number of batches merged into another one because the queue was full
+			std::atomic<int64_t> lastDeliveryLatency_;								//!< Time between queuing and delivering the last batch, in microseconds
+			std::atomic<int64_t> maxDeliveryLatency_;								//!< Maximum time between queuing and delivering a batch, in microseconds
+			std::mutex mutex_;														//!< Mutex used to sleep and wake up threads, and protecting the pending batch
+			std::condition_variable producerCondition_;								//!< Condition notified when a batch was delivered
+			std::condition_variable consumerCondition_;								//!< Condition notified when a batch was queued or the dispatcher is stopping
+			bool isStopping_;														//!< Whether the delivery thread should stop
+			std::thread thread_;													//!< Delivery thread
+
+			/**
+			 * @brief Queues a batch according to the overflow policy
+			 */
+			void enqueue(Batch&& batch);
+
+			/**
+			 * @brief Merges a batch into the pending batch
+			 */
+			void coalesce(Batch&& batch);
+
+			/**
+			 * @brief Queues the pending batch if the queue has room (`mutex_` must be held)
+			 *
+			 * @return *true* if there was no pending batch anymore or it was queued
+			 */
+			bool pushPendingBatch();
+
+			/**
+			 * @brief Counts a batch pushed to the queue and wakes the delivery thread up
+			 */
+			void notifyConsumer() noexcept;
+
+			/**
+			 * @brief Delivery thread's main function
+			 */
+			void run() noexcept;
+
+		public:
+			/**
+			 * @brief Construct a new Dispatcher object, starting its delivery thread
+			 *
+			 * @param controller controller whose metrics are dispatched
+			 * @param delegate delegate to give metrics to
+			 * @param capacity maximum number of queued batches
+			 * @param overflowPolicy what to do with a batch when the queue is full
+			 */
+			Dispatcher(Controller& controller, ControllerDelegate& delegate, size_t capacity, OverflowPolicy overflowPolicy);
+
+			/**
+			 * @brief Destroy the Dispatcher object, delivering queued batches and stopping its delivery thread
+			 */
+			~Dispatcher();
+
+			Dispatcher(const Dispatcher&) = delete;
+			Dispatcher& operator=(const Dispatcher&) = delete;
+
+
+			/**
+			 * @brief Returns the maximum number of queued batches
+			 */
+			size_t capacity() const noexcept;
+
+			/**
+			 * @brief Returns what is done with a batch when the queue is full
+			 */
+			OverflowPolicy overflowPolicy() const noexcept;
+
+			/**
+			 * @brief Returns the number of batches queued and not delivered yet
+			 */
+			size_t queueDepth() const noexcept;
+
+			/**
+			 * @brief Returns the number of batches dropped so far because the queue was full
+			 */
+			size_t droppedBatchCount() const noexcept;
+
+			/**
+			 * @brief Returns the number of batches merged into another one so far because the queue was full
+			 */
+			size_t coalescedBatchCount() const noexcept;
+
+			/**
+			 * @brief Returns the time between queuing and delivering the last batch
+			 */
+			std::chrono::microseconds lastDeliveryLatency() const noexcept;
+
+			/**
+			 * @brief Returns the maximum time between queuing and delivering a batch
+			 */
+			std::chrono::microseconds maxDeliveryLatency() const noexcept;
+
+
+			/**
+			 * @brief Queues metrics to be given to the delegate
+			 *
+			 * The metrics are taken from the array, which is left empty (but possibly with storage from a delivered batch, to avoid allocations).
+			 *
+			 * @param metrics the metrics to dispatch
+			 */
+			void dispatchMetrics(std::vector<Metric>& metrics);
+
+			/**
+			 * @brief Queues keys of evicted series to be given to the delegate
+			 *
+			 * @param keys keys of the evicted series
+			 */
+			void dispatchEvictedKeys(std::vector<Key>&& keys);
+
+			/**
+			 * @brief Waits until every queued batch is delivered
+			 */
+			void flush();
+	};
+}
@@ -24,9 +24,33 @@
 namespace AnyCollect {
 	std::cmatch Expression::match{};
 	
-	Expression::Expression(const std::string& pattern) noexcept :
-		regex_(pattern, std::regex_constants::ECMAScript | std::regex_constants::optimize)
-	{ }
+	Expression::Expression(const std::string& pattern, size_t maxSeries) noexcept :
+		regex_(pattern, std::regex_constants::ECMAScript | std::regex_constants::optimize),
+		isEnabled_(true)
+	{
+		if (maxSeries != 0) {
+			this->budget_ = std::make_shared<SeriesBudget>();
+			this->budget_->maxSeries = maxSeries;
+		}
+	}
+
+	Expression::Expression(const std::regex& regex, size_t maxSeries) noexcept :
+		regex_(regex),
+		isEnabled_(true)
+	{
+		if (maxSeries != 0) {
+			this->budget_ = std::make_shared<SeriesBudget>();
+			this->budget_->maxSeries = maxSeries;
+		}
+	}
+
+	const std::regex& Expression::regex() const noexcept {
+		return this->regex_;
+	}
+
+	const std::shared_ptr<SeriesBudget>& Expression::budget() const noexcept {
+		return this->budget_;
+	}
 
 
 	std::vector<std::shared_ptr<Matcher>>& Expression::matchers() noexcept {
@@ -37,6 +61,18 @@ namespace AnyCollect {
 		return this->matchers_;
 	}
 
+	bool Expression::isEnabled() const noexcept {
+		return this->isEnabled_;
+	}
+
+	Expression::Statistics& Expression::statistics() noexcept {
+		return this->statistics_;
+	}
+
+	void Expression::setEnabled(bool isEnabled) noexcept {
+		this->isEnabled_ = isEnabled;
+	}
+
 	const std::cmatch& Expression::apply(std::string_view::const_iterator begin, std::string_view::const_iterator end) {
 		std::regex_search(begin, end, match, this->regex_, std::regex_constants::match_default);
 		return match;
@@ -20,10 +20,12 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <regex>
 
 #include "Matcher.h"
+#include "SeriesBudget.h"
 
 
 namespace AnyCollect {
@@ -31,18 +33,50 @@ namespace AnyCollect {
 	 * @brief Class used to represent an expression (regex)
 	 */
 	class Expression {
+		public:
+			/**
+			 * @brief Statistics about the expression's applications since they were last reported, kept when self metrics are enabled
+			 */
+			struct Statistics {
+				size_t attemptCount = 0;							//!< Number of lines the regex was applied on
+				size_t matchCount = 0;								//!< Number of lines the regex matched
+				std::chrono::nanoseconds matchDuration{0};			//!< Time spent applying the regex
+			};
+
 		protected:
 			static std::cmatch match;								//!< Object used to store regex matches
 			std::regex regex_;										//!< Regex object
 			std::vector<std::shared_ptr<Matcher>> matchers_;		//!< Matchers associated with the receiver
+			std::shared_ptr<SeriesBudget> budget_;					//!< Budget of series created by all the receiver's matchers, if limited
+			bool isEnabled_;										//!< Whether the regex is applied on sources
+			Statistics statistics_;									//!< Statistics about the regex's applications
 
 		public:
 			/**
 			 * @brief Construct a new Expression object
 			 *
 			 * @param pattern regex string to use
+			 * @param maxSeries maximum number of series created by all the receiver's matchers (0 for no limit)
+			 */
+			Expression(const std::string& pattern, size_t maxSeries = 0) noexcept;
+
+			/**
+			 * @brief Construct a new Expression object from an already compiled regex
+			 *
+			 * @param regex regex to use
+			 * @param maxSeries maximum number of series created by all the receiver's matchers (0 for no limit)
+			 */
+			Expression(const std::regex& regex, size_t maxSeries = 0) noexcept;
+
+			/**
+			 * @brief Returns the compiled regex
 			 */
-			Expression(const std::string& pattern) noexcept;
+			const std::regex& regex() const noexcept;
+
+			/**
+			 * @brief Returns the budget of series created by all the receiver's matchers (null if not limited)
+			 */
+			const std::shared_ptr<SeriesBudget>& budget() const noexcept;
 
 			/**
 			 * @brief Returns the array of the receiver's matchers
@@ -54,6 +88,21 @@ namespace AnyCollect {
 			 */
 			const std::vector<std::shared_ptr<Matcher>>& matchers() const noexcept;
 
+			/**
+			 * @brief Returns whether the regex is applied on sources
+			 */
+			bool isEnabled() const noexcept;
+
+			/**
+			 * @brief Returns the statistics about the regex's applications
+			 */
+			Statistics& statistics() noexcept;
+
+			/**
+			 * @brief Sets whether the regex is applied on sources
+			 */
+			void setEnabled(bool isEnabled) noexcept;
+
 
 			/**
 			 * @brief Apply the regex and find matches in the given string
@@ -0,0 +1,44 @@
+//
+// Hash.cc
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "Hash.h"
+
+
+namespace AnyCollect {
+	Hasher::Hasher(uint64_t seed) noexcept {
+		XXH3_128bits_reset_withSeed(&this->state_, seed);
+	}
+
+
+	void Hasher::append(std::string_view str) noexcept {
+		this->append(static_cast<uint64_t>(str.size()));
+		XXH3_128bits_update(&this->state_, str.data(), str.size());
+	}
+
+	Key Hasher::finish() const noexcept {
+		XXH128_hash_t hash = XXH3_128bits_digest(&this->state_);
+		return Key{hash.low64, hash.high64};
+	}
+
+	Key Hasher::hash(std::string_view str) noexcept {
+		XXH128_hash_t hash = XXH3_128bits(str.data(), str.size());
+		return Key{hash.low64, hash.high64};
+	}
+}
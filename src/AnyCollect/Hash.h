@@ -0,0 +1,124 @@
+//
+// Hash.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+#define XXH_INLINE_ALL
+#include <xxhash/xxhash.h>
+
+
+namespace AnyCollect {
+	/**
+	 * @brief 128-bit key used to identify series
+	 */
+	struct Key {
+		uint64_t low;		//!< Lower 64 bits of the key
+		uint64_t high;		//!< Higher 64 bits of the key
+
+		bool operator==(const Key& other) const noexcept {
+			return this->low == other.low && this->high == other.high;
+		}
+
+		bool operator!=(const Key& other) const noexcept {
+			return !(*this == other);
+		}
+
+		bool operator<(const Key& other) const noexcept {
+			return this->high < other.high || (this->high == other.high && this->low < other.low);
+		}
+	};
+
+
+	/**
+	 * @brief Streaming 128-bit hasher, computing XXH3-128 (xxHash) over everything appended
+	 *
+	 * Every appended string is prefixed with its length, so that the boundaries between fields are part of the hash: `["ab", "c"]` and `["a", "bc"]` produce different keys.
+	 */
+	class Hasher {
+		protected:
+			XXH3_state_t state_;								//!< State of the streaming hash
+
+		public:
+			/**
+			 * @brief Construct a new Hasher object
+			 *
+			 * @param seed seed of the hash
+			 */
+			Hasher(uint64_t seed = 0) noexcept;
+
+			/**
+			 * @brief Appends a single 64-bit word to the hash
+			 *
+			 * @param word the word to append
+			 */
+			void append(uint64_t word) noexcept {
+				XXH3_128bits_update(&this->state_, &word, sizeof(word));
+			}
+
+			/**
+			 * @brief Appends a length-prefixed string to the hash
+			 *
+			 * @param str the string to append
+			 */
+			void append(std::string_view str) noexcept;
+
+			/**
+			 * @brief Appends a key to the hash
+			 *
+			 * @param key the key to append
+			 */
+			void append(const Key& key) noexcept {
+				this->append(key.low);
+				this->append(key.high);
+			}
+
+			/**
+			 * @brief Returns the key of everything appended so far
+			 */
+			Key finish() const noexcept;
+
+			/**
+			 * @brief Computes the key of a single string
+			 *
+			 * @param str string to hash
+			 * @return the string's key
+			 */
+			static Key hash(std::string_view str) noexcept;
+	};
+}
+
+
+namespace std {
+	/**
+	 * @brief Hash specialization allowing keys to be used in unordered containers
+	 *
+	 * Both halves are folded in, so that keys differing only in their higher bits do not share a bucket.
+	 */
+	template<>
+	struct hash<AnyCollect::Key> {
+		size_t operator()(const AnyCollect::Key& key) const noexcept {
+			return key.low ^ (key.high * 0x9e3779b97f4a7c15ull);
+		}
+	};
+}
@@ -18,7 +18,9 @@
 // limitations under the License.
 //
 
+#include <algorithm>
 #include <cmath>
+#include <iostream>
 
 #include <tinyexpr/tinyexpr.h>
 
@@ -26,7 +28,18 @@
 
 
 namespace AnyCollect {
-	Matcher::Matcher() noexcept { }
+	Matcher::Matcher() noexcept :
+		hasConstantTagKeys_(true),
+		overflowPolicy_(OverflowPolicyDrop),
+		counterType_(CounterTypeNone),
+		emission_(EmissionAlways),
+		deadband_(0),
+		relativeDeadband_(0),
+		heartbeat_(0),
+		isEnabled_(true)
+	{
+		this->internConstantPatterns();
+	}
 
 	Matcher::Matcher(const Config::expression::metric& config) noexcept :
 		name_(config.name),
@@ -34,8 +47,40 @@ namespace AnyCollect {
 		unit_(config.unit),
 		tags_(config.tags),
 		computeRate_(config.computeRate),
-		convertToUnitsPerSecond_(config.convertToUnitsPerSecond)
-	{ }
+		convertToUnitsPerSecond_(config.convertToUnitsPerSecond),
+		overflowPolicy_(OverflowPolicyDrop),
+		counterType_(CounterTypeNone),
+		emission_(EmissionAlways),
+		deadband_(std::max(config.deadband, 0.0)),
+		relativeDeadband_(std::max(config.relativeDeadband, 0.0)),
+		heartbeat_(config.heartbeat),
+		isEnabled_(true)
+	{
+		this->budget_.maxSeries = config.maxSeries;
+		if (config.overflowPolicy == Matcher::overflowPolicyFoldString)
+			this->overflowPolicy_ = OverflowPolicyFold;
+		else if (!config.overflowPolicy.empty() && config.overflowPolicy != Matcher::overflowPolicyDropString)
+			std::cerr << "Unknown overflow policy \"" << config.overflowPolicy << "\", new series will be dropped." << std::endl;
+		if (config.counterType == Matcher::counterTypeMonotonicString)
+			this->counterType_ = CounterTypeMonotonic;
+		else if (config.counterType == Matcher::counterTypeWrap32String)
+			this->counterType_ = CounterTypeWrap32;
+		else if (config.counterType == Matcher::counterTypeWrap64String)
+			this->counterType_ = CounterTypeWrap64;
+		else if (config.counterType == Matcher::counterTypeResetToZeroString)
+			this->counterType_ = CounterTypeResetToZero;
+		else if (!config.counterType.empty())
+			std::cerr << "Unknown counter type \"" << config.counterType << "\", differences will be used as is." << std::endl;
+		if (config.emission == Matcher::emissionOnChangeString || (config.emission.empty() && (this->deadband_ > 0 || this->relativeDeadband_ > 0)))
+			this->emission_ = EmissionOnChange;
+		else if (!config.emission.empty() && config.emission != Matcher::emissionAlwaysString)
+			std::cerr << "Unknown emission \"" << config.emission << "\", every value will be emitted." << std::endl;
+		this->internConstantPatterns();
+	}
+
+	Matcher::~Matcher() {
+		this->releaseConstantPatterns();
+	}
 
 
 	const std::vector<std::string>& Matcher::name() const noexcept {
@@ -62,9 +107,58 @@ namespace AnyCollect {
 		return this->convertToUnitsPerSecond_;
 	}
 
+	SeriesBudget& Matcher::budget() noexcept {
+		return this->budget_;
+	}
+
+	const SeriesBudget& Matcher::budget() const noexcept {
+		return this->budget_;
+	}
+
+	const std::shared_ptr<SeriesBudget>& Matcher::expressionBudget() const noexcept {
+		return this->expressionBudget_;
+	}
+
+	Matcher::OverflowPolicy Matcher::overflowPolicy() const noexcept {
+		return this->overflowPolicy_;
+	}
+
+	const std::shared_ptr<const Metric::Identity>& Matcher::overflowIdentity() const noexcept {
+		return this->overflowIdentity_;
+	}
+
+	Matcher::CounterType Matcher::counterType() const noexcept {
+		return this->counterType_;
+	}
+
+	Matcher::Emission Matcher::emission() const noexcept {
+		return this->emission_;
+	}
+
+	double Matcher::deadband() const noexcept {
+		return this->deadband_;
+	}
+
+	double Matcher::relativeDeadband() const noexcept {
+		return this->relativeDeadband_;
+	}
+
+	size_t Matcher::heartbeat() const noexcept {
+		return this->heartbeat_;
+	}
+
+	bool Matcher::isEnabled() const noexcept {
+		return this->isEnabled_;
+	}
+
+	Matcher::Statistics& Matcher::statistics() noexcept {
+		return this->statistics_;
+	}
+
 
 	void Matcher::setName(const std::vector<std::string>& name) noexcept {
 		this->name_ = name;
+		this->internConstantPatterns();
 	}
 
 	void Matcher::setValue(const std::string& value) noexcept {
@@ -73,10 +167,12 @@ namespace AnyCollect {
 
 	void Matcher::setUnit(const std::string& unit) noexcept {
 		this->unit_ = unit;
+		this->internConstantPatterns();
 	}
 
 	void Matcher::setTags(const std::map<std::string, std::string>& tags) noexcept {
 		this->tags_ = tags;
+		this->internConstantPatterns();
 	}
 
 	void Matcher::setComputeRate(bool computeRate) noexcept {
@@ -87,6 +183,29 @@ namespace AnyCollect {
 		this->convertToUnitsPerSecond_ = convertToUnitsPerSecond;
 	}
 
+	void Matcher::setExpressionBudget(const std::shared_ptr<SeriesBudget>& budget) noexcept {
+		this->expressionBudget_ = budget;
+	}
+
+	void Matcher::setOverflowPolicy(OverflowPolicy overflowPolicy) noexcept {
+		this->overflowPolicy_ = overflowPolicy;
+	}
+
+	void Matcher::setCounterType(CounterType counterType) noexcept {
+		this->counterType_ = counterType;
+	}
+
+	void Matcher::setEmission(Emission emission, double deadband, double relativeDeadband, size_t heartbeat) noexcept {
+		this->emission_ = emission;
+		this->deadband_ = std::max(deadband, 0.0);
+		this->relativeDeadband_ = std::max(relativeDeadband, 0.0);
+		this->heartbeat_ = heartbeat;
+	}
+
+	void Matcher::setEnabled(bool isEnabled) noexcept {
+		this->isEnabled_ = isEnabled;
+	}
+
 
 	inline uint64_t parseUint(const char*& buffer) noexcept {
 		uint64_t result = 0;
@@ -149,6 +268,59 @@ namespace AnyCollect {
 	}
 
 
+	inline bool isConstant(const std::string& pattern) {
+		return pattern.find(Matcher::matchSubstitutionPrefix) == std::string::npos && pattern.find(Matcher::matchEscapeChar) == std::string::npos;
+	}
+
+	inline std::optional<StringId> internIfConstant(const std::string& pattern) {
+		if (!isConstant(pattern))
+			return std::optional<StringId>{};
+		return StringPool::shared().intern(pattern);
+	}
+
+	inline void releaseIfInterned(const std::optional<StringId>& id) {
+		if (id.has_value())
+			StringPool::shared().release(id.value());
+	}
+
+	void Matcher::releaseConstantPatterns() noexcept {
+		for (const auto& id : this->nameIds_)
+			releaseIfInterned(id);
+		releaseIfInterned(this->unitId_);
+		for (const auto& [keyId, valueId] : this->tagIds_) {
+			releaseIfInterned(keyId);
+			releaseIfInterned(valueId);
+		}
+		this->nameIds_.clear();
+		this->unitId_.reset();
+		this->tagIds_.clear();
+	}
+
+	void Matcher::internConstantPatterns() {
+		this->releaseConstantPatterns();
+		for (const auto& part : this->name_)
+			this->nameIds_.push_back(internIfConstant(part));
+		this->unitId_ = internIfConstant(this->unit_);
+		this->tagIds_.clear();
+		this->hasConstantTagKeys_ = true;
+		for (const auto& [key, value] : this->tags_) {
+			this->tagIds_.emplace_back(internIfConstant(key), internIfConstant(value));
+			if (!this->tagIds_.back().first.has_value())
+				this->hasConstantTagKeys_ = false;
+		}
+
+		std::string overflow{Matcher::overflowString};
+		std::vector<std::string> overflowName;
+		for (size_t i = 0; i < this->name_.size(); i++)
+			overflowName.push_back(isConstant(this->name_[i]) ? this->name_[i] : overflow);
+		std::map<std::string, std::string> overflowTags;
+		for (const auto& [key, value] : this->tags_)
+			overflowTags.insert_or_assign(isConstant(key) ? key : overflow, isConstant(value) ? value : overflow);
+		auto overflowMetric = Metric::make(overflowName, overflowTags, isConstant(this->unit_) ? this->unit_ : "");
+		this->overflowIdentity_ = overflowMetric.has_value() ? overflowMetric.value().identity() : nullptr;
+	}
+
+
 	std::optional<std::vector<std::string>> Matcher::getName(const std::cmatch& match, const std::vector<std::string>& pathParts) const noexcept {
 		std::vector<std::string> name = this->name_;
 		for (auto& part : name) {
@@ -190,16 +362,131 @@ namespace AnyCollect {
 		return std::make_optional(std::move(tags));
 	}
 
+	/**
+	 * @brief Returns a pattern's interned string if it has no substitution, otherwise interns the substituted pattern, acquiring a reference either way
+	 */
+	inline std::optional<StringId> internPattern(const std::optional<StringId>& id, const std::string& pattern, const std::cmatch& match, const std::vector<std::string>& pathParts) {
+		if (id.has_value()) {
+			StringPool::shared().retain(id.value());
+			return id;
+		}
+		std::string str = pattern;
+		replaceMatches(str, match, pathParts);
+		return StringPool::shared().intern(str);
+	}
+
+	/**
+	 * @brief Returns a pattern's key, using the string pool when it has no substitution
+	 */
+	inline Key patternKey(const std::optional<StringId>& id, const std::string& pattern, const std::cmatch& match, const std::vector<std::string>& pathParts, bool& isEmpty) {
+		if (id.has_value()) {
+			isEmpty = (id.value() == StringPool::emptyId);
+			return StringPool::shared().key(id.value());
+		}
+		std::string str = pattern;
+		replaceMatches(str, match, pathParts);
+		isEmpty = str.empty();
+		return Hasher::hash(str);
+	}
+
+
+	std::optional<Key> Matcher::getKey(const std::cmatch& match, const std::vector<std::string>& pathParts) const noexcept {
+		Hasher hasher;
+		bool isEmpty = false;
+		hasher.append(static_cast<uint64_t>(this->name_.size()));
+		for (size_t i = 0; i < this->name_.size(); i++) {
+			hasher.append(patternKey(this->nameIds_[i], this->name_[i], match, pathParts, isEmpty));
+			if (isEmpty)
+				return std::optional<Key>{};
+		}
+
+		if (!this->hasConstantTagKeys_) {
+			auto tags = this->getTags(match, pathParts);
+			if (!tags.has_value())
+				return std::optional<Key>{};
+			hasher.append(static_cast<uint64_t>(tags.value().size()));
+			for (const auto& [key, value] : tags.value()) {
+				hasher.append(Hasher::hash(key));
+				hasher.append(Hasher::hash(value));
+			}
+			return std::make_optional(hasher.finish());
+		}
+
+		hasher.append(static_cast<uint64_t>(this->tags_.size()));
+		size_t i = 0;
+		for (const auto& [key, value] : this->tags_) {
+			hasher.append(patternKey(this->tagIds_[i].first, key, match, pathParts, isEmpty));
+			if (isEmpty)
+				return std::optional<Key>{};
+			hasher.append(patternKey(this->tagIds_[i].second, value, match, pathParts, isEmpty));
+			if (isEmpty)
+				return std::optional<Key>{};
+			i++;
+		}
+		return std::make_optional(hasher.finish());
+	}
+
 	std::optional<Metric> Matcher::getMetric(const std::cmatch& match, const std::vector<std::string>& pathParts) const noexcept {
-		auto name = this->getName(match, pathParts);
-		if (!name.has_value())
-			return std::optional<Metric>{};
-		auto unit = this->getUnit(match, pathParts);
-		if (!unit.has_value())
-			return std::optional<Metric>{};
-		auto tags = this->getTags(match, pathParts);
-		if (!tags.has_value())
+		auto& pool = StringPool::shared();
+		Metric::NameIds name;
+		Metric::TagIds tags;
+		StringId unit = StringPool::emptyId;
+
+		// References acquired so far are only handed over to the metric once every string could be interned
+		auto discard = [&]() {
+			for (auto part : name)
+				pool.release(part);
+			for (const auto& [keyId, valueId] : tags) {
+				pool.release(keyId);
+				pool.release(valueId);
+			}
+			pool.release(unit);
 			return std::optional<Metric>{};
-		return std::make_optional<Metric>(std::move(name.value()), std::move(tags.value()), std::move(unit.value()));
+		};
+
+		name.reserve(this->name_.size());
+		for (size_t i = 0; i < this->name_.size(); i++) {
+			auto part = internPattern(this->nameIds_[i], this->name_[i], match, pathParts);
+			if (!part.has_value() || part.value() == StringPool::emptyId)
+				return discard();
+			name.push_back(part.value());
+		}
+
+		auto unitId = internPattern(this->unitId_, this->unit_, match, pathParts);
+		if (!unitId.has_value())
+			return discard();
+		unit = unitId.value();
+
+		if (!this->hasConstantTagKeys_) {
+			auto tagStrings = this->getTags(match, pathParts);
+			if (!tagStrings.has_value())
+				return discard();
+			tags.reserve(tagStrings.value().size());
+			for (const auto& [key, value] : tagStrings.value()) {
+				auto keyId = pool.intern(key);
+				auto valueId = pool.intern(value);
+				if (!keyId.has_value() || !valueId.has_value()) {
+					pool.release(keyId.value_or(StringPool::emptyId));
+					pool.release(valueId.value_or(StringPool::emptyId));
+					return discard();
+				}
+				tags.emplace_back(keyId.value(), valueId.value());
+			}
+		} else {
+			tags.reserve(this->tags_.size());
+			size_t i = 0;
+			for (const auto& [key, value] : this->tags_) {
+				auto keyId = internPattern(this->tagIds_[i].first, key, match, pathParts);
+				auto valueId = internPattern(this->tagIds_[i].second, value, match, pathParts);
+				if (!keyId.has_value() || !valueId.has_value() || keyId.value() == StringPool::emptyId || valueId.value() == StringPool::emptyId) {
+					pool.release(keyId.value_or(StringPool::emptyId));
+					pool.release(valueId.value_or(StringPool::emptyId));
+					return discard();
+				}
+				tags.emplace_back(keyId.value(), valueId.value());
+				i++;
+			}
+		}
+		return std::make_optional<Metric>(std::move(name), std::move(tags), unit);
 	}
 }
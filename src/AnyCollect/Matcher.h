@@ -20,7 +20,9 @@
 
 #pragma once
 
+#include <cmath>
 #include <map>
+#include <memory>
 #include <optional>
 #include <regex>
 #include <string>
@@ -29,6 +31,7 @@
 
 #include "Config.h"
 #include "Metric.h"
+#include "SeriesBudget.h"
 
 using namespace std::literals;
 
@@ -42,6 +45,49 @@ namespace AnyCollect {
 			static constexpr char matchEscapeChar = '\\';									//!< Escape character
 			static constexpr char matchSubstitutionPrefix = '$';							//!< Variables prefix character
 			static constexpr std::string_view matchSubstitutionPathPrefix = "path_"sv;		//!< Path part prefix variable string
+			static constexpr std::string_view overflowString = "__overflow__"sv;			//!< Replacement of substituted strings in the overflow series
+
+			/**
+			 * @brief Enum of what to do with new series once a budget is exhausted
+			 */
+			enum OverflowPolicy {
+				OverflowPolicyDrop,			//!< Samples of new series are dropped
+				OverflowPolicyFold,			//!< Samples of new series are summed into the matcher's overflow series
+			};
+			static constexpr std::string_view overflowPolicyDropString = "Drop"sv;		//!< Configuration string of `OverflowPolicyDrop`
+			static constexpr std::string_view overflowPolicyFoldString = "Fold"sv;		//!< Configuration string of `OverflowPolicyFold`
+
+			/**
+			 * @brief Enum of how a rate should handle a counter going backwards
+			 */
+			enum CounterType {
+				CounterTypeNone,			//!< Differences are used as is
+				CounterTypeMonotonic,		//!< The counter only increases: a decrease is a reset, and leaves a gap
+				CounterTypeWrap32,			//!< The counter wraps around at 2^32 (a decrease from the lower half of the range is a reset, and leaves a gap)
+				CounterTypeWrap64,			//!< The counter wraps around at 2^64 (a decrease from the lower half of the range is a reset, and leaves a gap)
+				CounterTypeResetToZero,		//!< The counter restarts from zero: after a decrease, the new value is the difference
+			};
+			static constexpr std::string_view counterTypeMonotonicString = "Monotonic"sv;		//!< Configuration string of `CounterTypeMonotonic`
+			static constexpr std::string_view counterTypeWrap32String = "Wrap32"sv;			//!< Configuration string of `CounterTypeWrap32`
+			static constexpr std::string_view counterTypeWrap64String = "Wrap64"sv;			//!< Configuration string of `CounterTypeWrap64`
+			static constexpr std::string_view counterTypeResetToZeroString = "ResetToZero"sv;	//!< Configuration string of `CounterTypeResetToZero`
+
+			/**
+			 * @brief Enum of when the values of a series are given to the delegate
+			 */
+			enum Emission {
+				EmissionAlways,				//!< Every value is given to the delegate
+				EmissionOnChange,			//!< A value is only given to the delegate if it differs from the last given one by more than the deadbands, or if the heartbeat is due
+			};
+			static constexpr std::string_view emissionAlwaysString = "Always"sv;			//!< Configuration string of `EmissionAlways`
+			static constexpr std::string_view emissionOnChangeString = "OnChange"sv;		//!< Configuration string of `EmissionOnChange`
+
+			/**
+			 * @brief Statistics about the matcher's evaluations since they were last reported, kept when self metrics are enabled
+			 */
+			struct Statistics {
+				size_t failureCount = 0;			//!< Number of matches from which no value, key or metric could be computed
+			};
 
 		protected:
 			std::vector<std::string> name_;													//!< Pattern for the name of the metric
@@ -51,6 +97,33 @@ namespace AnyCollect {
 			bool computeRate_;																//!< Whether the metric is a rate
 			bool convertToUnitsPerSecond_;													//!< Whether the metric should be converted to units per second
 
+			std::vector<std::optional<StringId>> nameIds_;									//!< Interned name parts, for parts without substitution
+			std::optional<StringId> unitId_;												//!< Interned unit, if it has no substitution
+			std::vector<std::pair<std::optional<StringId>, std::optional<StringId>>> tagIds_;	//!< Interned tag keys and values without substitution, in `tags_` order
+			bool hasConstantTagKeys_;														//!< Whether no tag key has substitutions (tags order is then known in advance)
+
+			SeriesBudget budget_;															//!< Budget of series created by the matcher
+			std::shared_ptr<SeriesBudget> expressionBudget_;								//!< Budget of series created by the matcher's expression, if any
+			OverflowPolicy overflowPolicy_;													//!< What to do with new series once a budget is exhausted
+			std::shared_ptr<const Metric::Identity> overflowIdentity_;						//!< Identity of the series new series are folded into
+			CounterType counterType_;														//!< How rates handle the counter going backwards
+			Emission emission_;																//!< When values are given to the delegate
+			double deadband_;																//!< Minimum absolute change of a value to be given to the delegate
+			double relativeDeadband_;														//!< Minimum change of a value, relative to the last given one, to be given to the delegate
+			size_t heartbeat_;																//!< Number of iterations after which a value is given to the delegate even if it did not change (0 for never)
+			bool isEnabled_;																//!< Whether the matcher is evaluated on matches
+			Statistics statistics_;															//!< Statistics about the matcher's evaluations
+
+			/**
+			 * @brief Interns name parts, unit, tag keys and tag values which do not depend on matches
+			 */
+			void internConstantPatterns();
+
+			/**
+			 * @brief Releases the interned name parts, unit, tag keys and tag values which do not depend on matches
+			 */
+			void releaseConstantPatterns() noexcept;
+
 		public:
 			/**
 			 * @brief Construct a new Matcher object
@@ -64,6 +137,14 @@ namespace AnyCollect {
 			 */
 			Matcher(const Config::expression::metric& config) noexcept;
 
+			/**
+			 * @brief Destroy the Matcher object
+			 */
+			~Matcher();
+
+			Matcher(const Matcher&) = delete;
+			Matcher& operator=(const Matcher&) = delete;
+
 
 			/**
 			 * @brief Returns the pattern for the name of the metric
@@ -95,6 +176,68 @@ namespace AnyCollect {
 			 */
 			bool convertToUnitsPerSecond() const noexcept;
 
+			/**
+			 * @brief Returns the budget of series created by the matcher
+			 */
+			SeriesBudget& budget() noexcept;
+
+			/**
+			 * @brief Returns the budget of series created by the matcher
+			 */
+			const SeriesBudget& budget() const noexcept;
+
+			/**
+			 * @brief Returns the budget of series created by the matcher's expression (may be null)
+			 */
+			const std::shared_ptr<SeriesBudget>& expressionBudget() const noexcept;
+
+			/**
+			 * @brief Returns what to do with new series once a budget is exhausted
+			 */
+			OverflowPolicy overflowPolicy() const noexcept;
+
+			/**
+			 * @brief Returns the identity of the series new series are folded into
+			 *
+			 * Its name, tags and unit are the matcher's patterns, with every string containing a substitution replaced by `overflowString`. It is null if the string pool was full when the matcher was configured, in which case rejected series are dropped.
+			 */
+			const std::shared_ptr<const Metric::Identity>& overflowIdentity() const noexcept;
+
+			/**
+			 * @brief Returns how rates handle the counter going backwards
+			 */
+			CounterType counterType() const noexcept;
+
+			/**
+			 * @brief Returns when values are given to the delegate
+			 */
+			Emission emission() const noexcept;
+
+			/**
+			 * @brief Returns the minimum absolute change of a value to be given to the delegate
+			 */
+			double deadband() const noexcept;
+
+			/**
+			 * @brief Returns the minimum change of a value, relative to the last given one, to be given to the delegate
+			 */
+			double relativeDeadband() const noexcept;
+
+			/**
+			 * @brief Returns the number of iterations after which a value is given to the delegate even if it did not change (0 for never)
+			 */
+			size_t heartbeat() const noexcept;
+
+			/**
+			 * @brief Returns whether the matcher is evaluated on matches
+			 */
+			bool isEnabled() const noexcept;
+
+			/**
+			 * @brief Returns the statistics about the matcher's evaluations
+			 */
+			Statistics& statistics() noexcept;
+
 
 			/**
 			 * @brief Sets the pattern for the name of the metric
@@ -126,6 +269,78 @@ namespace AnyCollect {
 			 */
 			void setConvertToUnitsPerSecond(bool convertToUnitsPerSecond) noexcept;
 
+			/**
+			 * @brief Sets the budget of series created by the matcher's expression
+			 */
+			void setExpressionBudget(const std::shared_ptr<SeriesBudget>& budget) noexcept;
+
+			/**
+			 * @brief Sets what to do with new series once a budget is exhausted
+			 */
+			void setOverflowPolicy(OverflowPolicy overflowPolicy) noexcept;
+
+			/**
+			 * @brief Sets how rates handle the counter going backwards
+			 */
+			void setCounterType(CounterType counterType) noexcept;
+
+			/**
+			 * @brief Sets when values are given to the delegate
+			 *
+			 * @param emission when values are given to the delegate
+			 * @param deadband minimum absolute change of a value to be given to the delegate
+			 * @param relativeDeadband minimum change of a value, relative to the last given one, to be given to the delegate
+			 * @param heartbeat number of iterations after which a value is given to the delegate even if it did not change (0 for never)
+			 */
+			void setEmission(Emission emission, double deadband = 0, double relativeDeadband = 0, size_t heartbeat = 0) noexcept;
+
+			/**
+			 * @brief Sets whether the matcher is evaluated on matches
+			 */
+			void setEnabled(bool isEnabled) noexcept;
+
+			/**
+			 * @brief Returns whether a new value should be given to the delegate
+			 *
+			 * @param value the new value
+			 * @param emittedValue the last value given to the delegate
+			 * @param roundsSinceEmission number of iterations since the last value was given to the delegate
+			 */
+			bool shouldEmit(double value, double emittedValue, size_t roundsSinceEmission) const noexcept {
+				if (this->heartbeat_ != 0 && roundsSinceEmission >= this->heartbeat_)
+					return true;
+				double change = std::abs(value - emittedValue);
+				if (this->deadband_ == 0 && this->relativeDeadband_ == 0)
+					return value != emittedValue;
+				return change > this->deadband_ && change > this->relativeDeadband_ * std::abs(emittedValue);
+			}
+
+
+			/**
+			 * @brief Returns whether a new series can be created, according to the matcher's and expression's budgets
+			 */
+			bool canCreateSeries() const noexcept {
+				return !this->budget_.isExhausted() && (!this->expressionBudget_ || !this->expressionBudget_->isExhausted());
+			}
+
+			/**
+			 * @brief Accounts a new series (`count` is 1) or a removed series (`count` is -1) to the matcher's and expression's budgets
+			 */
+			void accountSeries(int count) noexcept {
+				this->budget_.seriesCount += count;
+				if (this->expressionBudget_)
+					this->expressionBudget_->seriesCount += count;
+			}
+
+			/**
+			 * @brief Accounts a new series rejected because of exhausted budgets
+			 */
+			void accountRejectedSeries() noexcept {
+				this->budget_.rejectedSeriesCount++;
+				if (this->expressionBudget_)
+					this->expressionBudget_->rejectedSeriesCount++;
+			}
+
 
 			/**
 			 * @brief Use an expression match to compute the metric's name
@@ -163,12 +378,23 @@ namespace AnyCollect {
 			 */
 			std::optional<std::map<std::string, std::string>> getTags(const std::cmatch& match, const std::vector<std::string>& pathParts) const noexcept;
 
+			/**
+			 * @brief Use an expression match to compute the key of the metric, without creating it
+			 *
+			 * Parts without substitution use the key cached in the string pool, so only substituted strings are hashed.
+			 *
+			 * @param match expression match to use
+			 * @param pathParts parts of the source file's path, if any
+			 * @return the key of the metric, or an empty `std::optional` if any of its fields couldn't be matched
+			 */
+			std::optional<Key> getKey(const std::cmatch& match, const std::vector<std::string>& pathParts) const noexcept;
+
 			/**
 			 * @brief Use an expression match to compute the metric
 			 *
 			 * @param match expression match to use
 			 * @param pathParts parts of the source file's path, if any
-			 * @return the computed metric, or an empty `std::optional` if any of its fields couldn't be matched
+			 * @return the computed metric, or an empty `std::optional` if any of its fields couldn't be matched or interned (see `StringPool::isFull`)
 			 */
 			std::optional<Metric> getMetric(const std::cmatch& match, const std::vector<std::string>& pathParts) const noexcept;
 	};
@@ -24,80 +24,139 @@
 
 
 namespace AnyCollect {
-	std::hash<std::string> Metric::hasher{};
+	Metric::Identity::Identity(Key key, NameIds&& name, TagIds&& tags, StringId unit) noexcept :
+		key(key),
+		name(std::move(name)),
+		tags(std::move(tags)),
+		unit(unit)
+	{ }
 
-	Metric::Metric(const std::vector<std::string>& name, const std::map<std::string, std::string>& tags, const std::string& unit) noexcept :
-		roundKey_(-1),
-		name_(name),
-		unit_(unit),
-		tags_(tags)
-	{
-		this->key_ = Metric::generateKey(this->name_, this->tags_);
+	Metric::Identity::~Identity() {
+		auto& pool = StringPool::shared();
+		for (auto part : this->name)
+			pool.release(part);
+		for (const auto& [k, v] : this->tags) {
+			pool.release(k);
+			pool.release(v);
+		}
+		pool.release(this->unit);
 	}
 
 
-	Metric::Metric(std::vector<std::string>&& name, std::map<std::string, std::string>&& tags, std::string&& unit) noexcept :
+	Metric::Metric(NameIds&& name, TagIds&& tags, StringId unit) noexcept :
 		roundKey_(-1),
-		name_(name),
-		unit_(unit),
-		tags_(tags)
+		value_(0.0)
 	{
-		this->key_ = Metric::generateKey(this->name_, this->tags_);
+		Key key = Metric::generateKey(name, tags);
+		this->identity_ = std::make_shared<const Identity>(key, std::move(name), std::move(tags), unit);
 	}
 
-
-	Metric::Metric(const Metric& other) noexcept :
-		key_(other.key_),
-		roundKey_(other.roundKey_),
-		name_(other.name_),
-		previousValue_(other.previousValue_),
-		value_(other.value_),
-		timestamp_(other.timestamp_),
-		unit_(other.unit_),
-		tags_(other.tags_)
+	Metric::Metric(std::shared_ptr<const Identity> identity, double value, std::chrono::system_clock::time_point timestamp, size_t roundKey) noexcept :
+		identity_(std::move(identity)),
+		roundKey_(roundKey),
+		value_(value),
+		timestamp_(timestamp)
 	{ }
 
-	Metric::Metric(Metric&& other) noexcept :
-		key_(other.key_),
-		roundKey_(other.roundKey_),
-		name_(std::move(other.name_)),
-		previousValue_(other.previousValue_),
-		value_(other.value_),
-		timestamp_(other.timestamp_),
-		unit_(std::move(other.unit_)),
-		tags_(std::move(other.tags_))
-	{ }
 
-	Metric& Metric::operator=(Metric other) noexcept {
-		this->key_ = other.key_;
-		this->roundKey_ = other.roundKey_;
-		std::swap(this->name_, other.name_);
-		this->previousValue_ = other.previousValue_;
-		this->value_ = other.value_;
-		this->timestamp_ = other.timestamp_;
-		std::swap(this->unit_, other.unit_);
-		std::swap(this->tags_, other.tags_);
-		return *this;
+	std::optional<Metric> Metric::make(const std::vector<std::string>& name, const std::map<std::string, std::string>& tags, const std::string& unit) noexcept {
+		auto& pool = StringPool::shared();
+		NameIds nameIds;
+		TagIds tagIds;
+		std::optional<StringId> unitId;
+
+		// Strings interned so far are released if another one cannot be, so that no identity is built from missing strings
+		auto discard = [&]() {
+			for (auto part : nameIds)
+				pool.release(part);
+			for (const auto& [keyId, valueId] : tagIds) {
+				pool.release(keyId);
+				pool.release(valueId);
+			}
+			return std::optional<Metric>{};
+		};
+
+		nameIds.reserve(name.size());
+		for (const auto& part : name) {
+			auto id = pool.intern(part);
+			if (!id.has_value())
+				return discard();
+			nameIds.push_back(id.value());
+		}
+		tagIds.reserve(tags.size());
+		for (const auto& [key, value] : tags) {
+			auto keyId = pool.intern(key);
+			auto valueId = pool.intern(value);
+			if (!keyId.has_value() || !valueId.has_value()) {
+				pool.release(keyId.value_or(StringPool::emptyId));
+				pool.release(valueId.value_or(StringPool::emptyId));
+				return discard();
+			}
+			tagIds.emplace_back(keyId.value(), valueId.value());
+		}
+		unitId = pool.intern(unit);
+		if (!unitId.has_value())
+			return discard();
+		return std::make_optional<Metric>(std::move(nameIds), std::move(tagIds), unitId.value());
 	}
 
 
-	size_t Metric::generateKey(const std::vector<std::string>& name, const std::map<std::string, std::string>& tags) {
-		std::string hash;
+	Key Metric::generateKey(const std::vector<std::string>& name, const std::map<std::string, std::string>& tags) noexcept {
+		Hasher hasher;
+		hasher.append(static_cast<uint64_t>(name.size()));
 		for (const auto& n : name)
-			hash.append(n);
+			hasher.append(Hasher::hash(n));
+		hasher.append(static_cast<uint64_t>(tags.size()));
 		for (const auto& [k, v] : tags) {
-			hash.append(k);
-			hash.append(v);
+			hasher.append(Hasher::hash(k));
+			hasher.append(Hasher::hash(v));
 		}
-		return Metric::hasher(hash);
+		return hasher.finish();
 	}
 
-	const std::vector<std::string>& Metric::name() const noexcept {
-		return this->name_;
+	Key Metric::generateKey(const Metric& metric) noexcept {
+		return Metric::generateKey(metric.identity_->name, metric.identity_->tags);
 	}
 
-	size_t Metric::key() const noexcept {
-		return this->key_;
+	Key Metric::generateKey(const NameIds& name, const TagIds& tags) noexcept {
+		const auto& pool = StringPool::shared();
+		Hasher hasher;
+		hasher.append(static_cast<uint64_t>(name.size()));
+		for (const auto& n : name)
+			hasher.append(pool.key(n));
+		hasher.append(static_cast<uint64_t>(tags.size()));
+		for (const auto& [k, v] : tags) {
+			hasher.append(pool.key(k));
+			hasher.append(pool.key(v));
+		}
+		return hasher.finish();
+	}
+
+
+	bool Metric::hasSameIdentity(const Metric& other) const noexcept {
+		return this->identity_ == other.identity_ || (this->identity_->name == other.identity_->name && this->identity_->tags == other.identity_->tags);
+	}
+
+
+	const std::shared_ptr<const Metric::Identity>& Metric::identity() const noexcept {
+		return this->identity_;
+	}
+
+	std::vector<std::string> Metric::name() const {
+		const auto& pool = StringPool::shared();
+		std::vector<std::string> name;
+		name.reserve(this->identity_->name.size());
+		for (const auto& n : this->identity_->name)
+			name.push_back(pool.string(n));
+		return name;
+	}
+
+	const Metric::NameIds& Metric::nameIds() const noexcept {
+		return this->identity_->name;
+	}
+
+	const Key& Metric::key() const noexcept {
+		return this->identity_->key;
 	}
 
 	size_t Metric::roundKey() const noexcept {
@@ -113,35 +172,35 @@ namespace AnyCollect {
 	}
 
 	const std::string& Metric::unit() const noexcept {
-		return this->unit_;
+		return StringPool::shared().string(this->identity_->unit);
 	}
 
-	const std::map<std::string, std::string>& Metric::tags() const noexcept {
-		return this->tags_;
+	StringId Metric::unitId() const noexcept {
+		return this->identity_->unit;
 	}
 
+	std::map<std::string, std::string> Metric::tags() const {
+		const auto& pool = StringPool::shared();
+		std::map<std::string, std::string> tags;
+		for (const auto& [k, v] : this->identity_->tags)
+			tags.emplace_hint(tags.end(), pool.string(k), pool.string(v));
+		return tags;
+	}
 
-	void Metric::setNewValue(double value, bool computeRate, double unitsPerSecondFactor) noexcept {
-		if (computeRate)
-			this->value_ = value - this->previousValue_;
-		else
-			this->value_ = value;
-		this->previousValue_ = value;
-		this->value_ *= unitsPerSecondFactor;
+	const Metric::TagIds& Metric::tagIds() const noexcept {
+		return this->identity_->tags;
 	}
 
-	void Metric::updateValue(double value, double unitsPerSecondFactor) noexcept {
-		this->value_ /= unitsPerSecondFactor;
-		this->value_ += value;
-		this->previousValue_ += value;
-		this->value_ *= unitsPerSecondFactor;
+
+	void Metric::setValue(double value) noexcept {
+		this->value_ = value;
 	}
 
 	void Metric::setTimestamp(std::chrono::system_clock::time_point timestamp) noexcept {
 		this->timestamp_ = timestamp;
 	}
 
-	void Metric::setRoundKey(size_t roundKey) noexcept{
+	void Metric::setRoundKey(size_t roundKey) noexcept {
 		this->roundKey_ = roundKey;
 	}
 }
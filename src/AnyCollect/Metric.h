@@ -22,25 +22,57 @@
 
 #include <chrono>
 #include <map>
+#include <memory>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "Hash.h"
+#include "StringPool.h"
+
 
 namespace AnyCollect {
 	/**
 	 * @brief Class used to represent a metric object (with a name, unit, tags, a value and a timestamp)
+	 *
+	 * The identity of a metric (name, tags and unit) is stored as interned string identifiers (see `StringPool`), and is shared by all metric objects of the same series. Metric objects are values: the series state used to compute them lives in `MetricStore`.
 	 */
 	class Metric {
+		public:
+			using NameIds = std::vector<StringId>;							//!< Type of interned name parts
+			using TagIds = std::vector<std::pair<StringId, StringId>>;		//!< Type of interned tags, sorted by tag key
+
+			/**
+			 * @brief Identity of a series: its key, name, tags and unit
+			 *
+			 * An identity owns one reference to each of its interned strings, and releases them when destroyed.
+			 */
+			struct Identity {
+				Key key;													//!< Key of the series (hash of its name, tag keys and tags values)
+				NameIds name;												//!< Array of interned strings representing the name of the series
+				TagIds tags;												//!< Interned tags of the series, sorted by tag key
+				StringId unit;												//!< Interned unit of the series
+
+				/**
+				 * @brief Construct a new Identity object, taking over one reference to each interned string
+				 */
+				Identity(Key key, NameIds&& name, TagIds&& tags, StringId unit) noexcept;
+
+				/**
+				 * @brief Destroy the Identity object, releasing its interned strings
+				 */
+				~Identity();
+
+				Identity(const Identity&) = delete;
+				Identity& operator=(const Identity&) = delete;
+			};
+
 		protected:
-			static std::hash<std::string> hasher;					//!< Object used to compute keys (string hashes)
-			size_t key_;											//!< Key of the metric (hash of its name, tag keys and tags values)
+			std::shared_ptr<const Identity> identity_;				//!< Identity of the metric
 			size_t roundKey_;										//!< Key of the collection iteration which created this metric
-			std::vector<std::string> name_;							//!< Array of strings representing the name of the metric
-			double previousValue_;									//!< Previous value of the metric
 			double value_;											//!< Current value of the metric
 			std::chrono::system_clock::time_point timestamp_;		//!< Timestamp of the metric
-			std::string unit_;										//!< Unit of the metric
-			std::map<std::string, std::string> tags_;				//!< Tags of the metric
 
 		public:
 			/**
@@ -49,53 +81,48 @@ namespace AnyCollect {
 			Metric() = delete;
 
 			/**
-			 * @brief Construct a new Metric object
+			 * @brief Construct a new Metric object from interned strings
 			 *
-			 * @param name name of the metric
-			 * @param tags tags of the metric
-			 * @param unit unit of the metric
-			 */
-			Metric(const std::vector<std::string>& name, const std::map<std::string, std::string>& tags, const std::string& unit = "") noexcept;
-
-			/**
-			 * @brief Construct a new Metric object
+			 * The metric's identity takes over one reference to each interned string.
 			 *
-			 * @param name name of the metric
-			 * @param tags tags of the metric
-			 * @param unit unit of the metric
+			 * @param name interned name of the metric
+			 * @param tags interned tags of the metric, sorted by tag key string
+			 * @param unit interned unit of the metric
 			 */
-			Metric(std::vector<std::string>&& name, std::map<std::string, std::string>&& tags, std::string&& unit = "") noexcept;
+			Metric(NameIds&& name, TagIds&& tags, StringId unit = StringPool::emptyId) noexcept;
 
 			/**
-			 * @brief Copy constructor
+			 * @brief Construct a new Metric object of an existing series
 			 *
-			 * @param other metric to copy
+			 * @param identity identity of the series
+			 * @param value value of the metric
+			 * @param timestamp timestamp of the metric
+			 * @param roundKey key of the collection iteration which created the metric
 			 */
-			Metric(const Metric& other) noexcept;
+			Metric(std::shared_ptr<const Identity> identity, double value, std::chrono::system_clock::time_point timestamp, size_t roundKey) noexcept;
 
-			/**
-			 * @brief Move constructor
-			 *
-			 * @param other metric to move
-			 */
-			Metric(Metric&& other) noexcept;
 
 			/**
-			 * @brief Assignment operator
+			 * @brief Creates a new Metric object, interning its strings
 			 *
-			 * @param other metric to copy
+			 * @param name name of the metric
+			 * @param tags tags of the metric
+			 * @param unit unit of the metric
+			 * @return the metric, or nothing if the string pool is full (no string is then kept interned)
 			 */
-			Metric& operator=(Metric other) noexcept;
+			static std::optional<Metric> make(const std::vector<std::string>& name, const std::map<std::string, std::string>& tags, const std::string& unit = "") noexcept;
 
 
 			/**
 			 * @brief Compute the key of potential metric
 			 *
+			 * Name parts, tag keys and tag values are length-prefixed, and the number of name parts and tags are hashed too, so that no two different identities produce the same input to the hash function.
+			 *
 			 * @param name name of the metric
 			 * @param tags tags of the metric
 			 * @return the potential metric's key
 			 */
-			static size_t generateKey(const std::vector<std::string>& name, const std::map<std::string, std::string>& tags);
+			static Key generateKey(const std::vector<std::string>& name, const std::map<std::string, std::string>& tags) noexcept;
 
 			/**
 			 * @brief Compute the key of a metric
@@ -103,18 +130,49 @@ namespace AnyCollect {
 			 * @param metric the metric to compute the key of
 			 * @return the potential metric's key
 			 */
-			static size_t generateKey(const Metric& metric);
+			static Key generateKey(const Metric& metric) noexcept;
+
+			/**
+			 * @brief Compute the key of potential metric from interned strings
+			 *
+			 * Interned strings already carry their own key, so this only hashes two words per name part, tag key or tag value. The result is the same as with the string overload.
+			 *
+			 * @param name interned name of the metric
+			 * @param tags interned tags of the metric, sorted by tag key string
+			 * @return the potential metric's key
+			 */
+			static Key generateKey(const NameIds& name, const TagIds& tags) noexcept;
 
 
+			/**
+			 * @brief Returns whether two metrics have the same identity (name and tags), regardless of their keys
+			 *
+			 * @param other the metric to compare with
+			 * @return *true* if both metrics represent the same series
+			 * @return *false* otherwise
+			 */
+			bool hasSameIdentity(const Metric& other) const noexcept;
+
+
+			/**
+			 * @brief Returns the identity of the metric
+			 */
+			const std::shared_ptr<const Identity>& identity() const noexcept;
+
 			/**
 			 * @brief Returns the name of the metric
 			 */
-			const std::vector<std::string>& name() const noexcept;
+			std::vector<std::string> name() const;
+
+			/**
+			 * @brief Returns the interned name of the metric
+			 */
+			const NameIds& nameIds() const noexcept;
 
 			/**
 			 * @brief Returns the key of the metric
 			 */
-			size_t key() const noexcept;
+			const Key& key() const noexcept;
 
 			/**
 			 * @brief Returns the key of the collection iteration which created the metric
@@ -137,29 +195,25 @@ namespace AnyCollect {
 			const std::string& unit() const noexcept;
 
 			/**
-			 * @brief Returns the tags of the metric
+			 * @brief Returns the interned unit of the metric
 			 */
-			const std::map<std::string, std::string>& tags() const noexcept;
+			StringId unitId() const noexcept;
 
+			/**
+			 * @brief Returns the tags of the metric
+			 */
+			std::map<std::string, std::string> tags() const;
 
 			/**
-			 * @brief Sets a new value to the metric
-			 *
-			 * @param value the new value
-			 * @param computeRate whether the rate should be computed (as `previousValue_ - value`)
-			 * @param unitsPerSecondFactor factor to convert the value into units per seconds
+			 * @brief Returns the interned tags of the metric, sorted by tag key
 			 */
-			void setNewValue(double value, bool computeRate, double unitsPerSecondFactor = 1.0) noexcept;
+			const TagIds& tagIds() const noexcept;
+
 
 			/**
-			 * @brief Adds a new value to the current value
-			 *
-			 * When a matcher computes the same metric during a single collection iteration (same round key), the different computed values are summed
-			 *
-			 * @param value The value to add
-			 * @param unitsPerSecondFactor factor to convert the value into units per seconds
+			 * @brief Sets the value of the metric
 			 */
-			void updateValue(double value, double unitsPerSecondFactor = 1.0) noexcept;
+			void setValue(double value) noexcept;
 
 			/**
 			 * @brief Sets the timestamp of the metric
@@ -0,0 +1,41 @@
+//
+// MetricSnapshot.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "Metric.h"
+
+
+namespace AnyCollect {
+	/**
+	 * @brief Struct used to publish a read-only view of every series after a collection iteration
+	 *
+	 * Snapshots are immutable once published, so any number of threads may read them while the controller keeps collecting.
+	 */
+	struct MetricSnapshot {
+		size_t roundKey = 0;								//!< Key of the collection iteration the snapshot was taken at
+		std::chrono::system_clock::time_point timestamp;	//!< Time the snapshot was taken at
+		std::vector<Metric> metrics;						//!< Latest metric of every series
+	};
+}
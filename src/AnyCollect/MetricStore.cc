@@ -0,0 +1,168 @@
+//
+// MetricStore.cc
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "MetricStore.h"
+
+
+namespace AnyCollect {
+	MetricStore::MetricStore() noexcept :
+		slots_(MetricStore::minCapacity, Slot{MetricStore::npos, 0}),
+		mask_(MetricStore::minCapacity - 1)
+	{ }
+
+
+	void MetricStore::rehash(size_t capacity) {
+		this->slots_.assign(capacity, Slot{MetricStore::npos, 0});
+		this->mask_ = capacity - 1;
+		for (Index index = 0; index < this->keys_.size(); index++) {
+			size_t slot = this->keys_[index].low & this->mask_;
+			while (this->slots_[slot].index != MetricStore::npos)
+				slot = (slot + 1) & this->mask_;
+			this->slots_[slot] = Slot{index, MetricStore::tagOf(this->keys_[index])};
+		}
+	}
+
+	size_t MetricStore::capacityFor(size_t size) noexcept {
+		size_t capacity = MetricStore::minCapacity;
+		while (size * 2 > capacity)
+			capacity *= 2;
+		return capacity;
+	}
+
+	void MetricStore::moveSeries(Index from, Index to) noexcept {
+		this->keys_[to] = this->keys_[from];
+		this->values_[to] = this->values_[from];
+		this->previousValues_[to] = this->previousValues_[from];
+		this->unitsPerSecondFactors_[to] = this->unitsPerSecondFactors_[from];
+		this->timestamps_[to] = this->timestamps_[from];
+		this->roundKeys_[to] = this->roundKeys_[from];
+		this->updateRounds_[to] = this->updateRounds_[from];
+		this->resetCounts_[to] = this->resetCounts_[from];
+		this->emittedValues_[to] = this->emittedValues_[from];
+		this->emittedRounds_[to] = this->emittedRounds_[from];
+		this->identities_[to] = std::move(this->identities_[from]);
+		this->owners_[to] = this->owners_[from];
+		this->history_.moveSeries(from, to);
+	}
+
+	void MetricStore::truncate(size_t size) {
+		this->keys_.resize(size);
+		this->values_.resize(size);
+		this->previousValues_.resize(size);
+		this->unitsPerSecondFactors_.resize(size);
+		this->timestamps_.resize(size);
+		this->roundKeys_.resize(size);
+		this->updateRounds_.resize(size);
+		this->resetCounts_.resize(size);
+		this->emittedValues_.resize(size);
+		this->emittedRounds_.resize(size);
+		this->identities_.resize(size);
+		this->owners_.resize(size);
+		this->history_.truncate(size);
+
+		// Give memory back once most series are gone
+		if (this->keys_.capacity() > 4 * size) {
+			this->keys_.shrink_to_fit();
+			this->values_.shrink_to_fit();
+			this->previousValues_.shrink_to_fit();
+			this->unitsPerSecondFactors_.shrink_to_fit();
+			this->timestamps_.shrink_to_fit();
+			this->roundKeys_.shrink_to_fit();
+			this->updateRounds_.shrink_to_fit();
+			this->resetCounts_.shrink_to_fit();
+			this->emittedValues_.shrink_to_fit();
+			this->emittedRounds_.shrink_to_fit();
+			this->identities_.shrink_to_fit();
+			this->owners_.shrink_to_fit();
+		}
+		this->rehash(MetricStore::capacityFor(size));
+		this->slots_.shrink_to_fit();
+	}
+
+	MetricStore::Index MetricStore::insert(std::shared_ptr<const Metric::Identity> identity, Matcher* owner) {
+		// Keep the load factor under 1/2 so that probe sequences stay short
+		if ((this->keys_.size() + 1) * 2 > this->slots_.size())
+			this->rehash(this->slots_.size() * 2);
+
+		Index index = static_cast<Index>(this->keys_.size());
+		const Key& key = identity->key;
+		size_t slot = key.low & this->mask_;
+		while (this->slots_[slot].index != MetricStore::npos)
+			slot = (slot + 1) & this->mask_;
+		this->slots_[slot] = Slot{index, MetricStore::tagOf(key)};
+
+		this->keys_.push_back(key);
+		this->values_.push_back(0.0);
+		this->previousValues_.push_back(0.0);
+		this->unitsPerSecondFactors_.push_back(1.0);
+		this->timestamps_.emplace_back();
+		this->roundKeys_.push_back(-1);
+		this->updateRounds_.push_back(0);
+		this->resetCounts_.push_back(0);
+		this->emittedValues_.push_back(0.0);
+		this->emittedRounds_.push_back(-1);
+		this->identities_.push_back(std::move(identity));
+		this->owners_.push_back(owner);
+		if (this->history_.isEnabled())
+			this->history_.resize(this->keys_.size());
+		return index;
+	}
+
+	void MetricStore::clear() noexcept {
+		this->slots_.assign(MetricStore::minCapacity, Slot{MetricStore::npos, 0});
+		this->mask_ = MetricStore::minCapacity - 1;
+		this->keys_.clear();
+		this->values_.clear();
+		this->previousValues_.clear();
+		this->unitsPerSecondFactors_.clear();
+		this->timestamps_.clear();
+		this->roundKeys_.clear();
+		this->updateRounds_.clear();
+		this->resetCounts_.clear();
+		this->emittedValues_.clear();
+		this->emittedRounds_.clear();
+		this->identities_.clear();
+		this->owners_.clear();
+		this->history_.truncate(0);
+	}
+
+	void MetricStore::reserve(size_t size) {
+		size_t capacity = MetricStore::capacityFor(size);
+		if (capacity > this->slots_.size())
+			this->rehash(capacity);
+		this->keys_.reserve(size);
+		this->values_.reserve(size);
+		this->previousValues_.reserve(size);
+		this->unitsPerSecondFactors_.reserve(size);
+		this->timestamps_.reserve(size);
+		this->roundKeys_.reserve(size);
+		this->updateRounds_.reserve(size);
+		this->resetCounts_.reserve(size);
+		this->emittedValues_.reserve(size);
+		this->emittedRounds_.reserve(size);
+		this->identities_.reserve(size);
+		this->owners_.reserve(size);
+		this->history_.reserve(size);
+	}
+
+	void MetricStore::setHistoryResolutions(std::vector<SeriesHistory::Resolution> resolutions) {
+		this->history_.setResolutions(std::move(resolutions), this->keys_.size());
+	}
+}
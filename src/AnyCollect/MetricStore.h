@@ -0,0 +1,382 @@
+//
+// MetricStore.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Hash.h"
+#include "Metric.h"
+#include "SeriesHistory.h"
+
+
+namespace AnyCollect {
+	class Matcher;
+
+	/**
+	 * @brief Class used to store the state of every series, indexed by series key
+	 *
+	 * Series are stored as a structure of arrays: each field is a contiguous column indexed by the series index, so that the values updated every round are packed together and away from the series identities. Keys are indexed by a flat open-addressing hash table (linear probing) holding series indexes.
+	 */
+	class MetricStore {
+		public:
+			using Index = uint32_t;													//!< Type of series indexes
+			static constexpr Index npos = static_cast<Index>(-1);					//!< Invalid series index
+
+		protected:
+			/**
+			 * @brief Slot of the hash table
+			 */
+			struct Slot {
+				Index index;														//!< Index of the series, or `npos` if the slot is empty
+				uint32_t tag;														//!< Bits of the key not used to pick the slot, to skip most mismatches without reading the keys column
+			};
+
+			static constexpr size_t minCapacity = 16;								//!< Minimum number of slots of the hash table
+
+			std::vector<Slot> slots_;												//!< Hash table associating keys to series indexes
+			size_t mask_;															//!< Number of slots minus one (the number of slots is a power of two)
+
+			std::vector<Key> keys_;													//!< Column of series keys
+			std::vector<double> values_;											//!< Column of current values
+			std::vector<double> previousValues_;									//!< Column of previous values (as read, before rate computation)
+			std::vector<double> unitsPerSecondFactors_;								//!< Column of the factors used to convert current values into units per second
+			std::vector<std::chrono::system_clock::time_point> timestamps_;			//!< Column of timestamps
+			std::vector<size_t> roundKeys_;											//!< Column of the keys of the last collection iteration which updated each series
+			std::vector<size_t> updateRounds_;										//!< Column of the numbers of the last collection rounds which updated each series
+			std::vector<uint32_t> resetCounts_;										//!< Column of the number of counter resets detected in each series
+			std::vector<double> emittedValues_;										//!< Column of the last values given to the delegate (only kept for series with an emission policy)
+			std::vector<size_t> emittedRounds_;										//!< Column of the numbers of the collection rounds which last gave each series to the delegate (only kept for series with an emission policy)
+			std::vector<std::shared_ptr<const Metric::Identity>> identities_;		//!< Column of series identities (cold data)
+			std::vector<Matcher*> owners_;											//!< Column of the matchers which created each series, if any (cold data)
+			SeriesHistory history_;													//!< Recent values of every series, if enabled
+
+			/**
+			 * @brief Returns the tag stored in a slot for a key
+			 */
+			static uint32_t tagOf(const Key& key) noexcept {
+				return static_cast<uint32_t>(key.high >> 32);
+			}
+
+			/**
+			 * @brief Resizes the hash table and reinserts all series
+			 *
+			 * @param capacity new number of slots (a power of two)
+			 */
+			void rehash(size_t capacity);
+
+			/**
+			 * @brief Returns the number of slots needed to hold a number of series
+			 */
+			static size_t capacityFor(size_t size) noexcept;
+
+			/**
+			 * @brief Moves a series to a lower index, overwriting the series at that index (the hash table is not updated)
+			 */
+			void moveSeries(Index from, Index to) noexcept;
+
+			/**
+			 * @brief Drops every series after the specified number, and rebuilds the hash table
+			 */
+			void truncate(size_t size);
+
+		public:
+			/**
+			 * @brief Construct a new empty MetricStore object
+			 */
+			MetricStore() noexcept;
+
+
+			/**
+			 * @brief Returns the number of series
+			 */
+			size_t size() const noexcept {
+				return this->keys_.size();
+			}
+
+			/**
+			 * @brief Finds a series
+			 *
+			 * @param key key of the series
+			 * @return the index of the series, or `npos` if it is not in the store
+			 */
+			Index find(const Key& key) const noexcept {
+				uint32_t tag = MetricStore::tagOf(key);
+				size_t slot = key.low & this->mask_;
+				while (this->slots_[slot].index != MetricStore::npos) {
+					if (this->slots_[slot].tag == tag && this->keys_[this->slots_[slot].index] == key)
+						return this->slots_[slot].index;
+					slot = (slot + 1) & this->mask_;
+				}
+				return MetricStore::npos;
+			}
+
+			/**
+			 * @brief Adds a new series, which must not already be in the store
+			 *
+			 * @param identity identity of the series
+			 * @param owner matcher which created the series, if any
+			 * @return the index of the new series
+			 */
+			Index insert(std::shared_ptr<const Metric::Identity> identity, Matcher* owner = nullptr);
+
+			/**
+			 * @brief Removes series and compacts the columns
+			 *
+			 * Remaining series keep their relative order but their indexes change, so previously returned indexes are invalidated.
+			 *
+			 * @tparam Function type of the predicate
+			 * @param shouldRemove predicate called with the index of each series, before any series is moved; returns *true* if the series should be removed
+			 * @return the number of removed series
+			 */
+			template<typename Function>
+			size_t compact(Function&& shouldRemove) {
+				Index kept = 0;
+				for (Index index = 0; index < this->keys_.size(); index++) {
+					if (shouldRemove(index))
+						continue;
+					if (kept != index)
+						this->moveSeries(index, kept);
+					kept++;
+				}
+				size_t removed = this->keys_.size() - kept;
+				if (removed > 0)
+					this->truncate(kept);
+				return removed;
+			}
+
+			/**
+			 * @brief Removes all series
+			 */
+			void clear() noexcept;
+
+			/**
+			 * @brief Reserves memory for a number of series
+			 */
+			void reserve(size_t size);
+
+
+			/**
+			 * @brief Returns the history of the series
+			 */
+			const SeriesHistory& history() const noexcept {
+				return this->history_;
+			}
+
+			/**
+			 * @brief Sets the resolutions of the history kept for every series, dropping any recorded history
+			 *
+			 * @param resolutions the history levels (empty to disable history)
+			 */
+			void setHistoryResolutions(std::vector<SeriesHistory::Resolution> resolutions);
+
+			/**
+			 * @brief Appends the current value of a series to its history, if enabled
+			 */
+			void recordHistory(Index index) noexcept {
+				if (this->history_.isEnabled())
+					this->history_.append(index, this->timestamps_[index], this->values_[index]);
+			}
+
+
+			/**
+			 * @brief Returns the key of a series
+			 */
+			const Key& key(Index index) const noexcept {
+				return this->keys_[index];
+			}
+
+			/**
+			 * @brief Returns the identity of a series
+			 */
+			const std::shared_ptr<const Metric::Identity>& identity(Index index) const noexcept {
+				return this->identities_[index];
+			}
+
+			/**
+			 * @brief Returns the matcher which created a series (null for internal and overflow series)
+			 */
+			Matcher* owner(Index index) const noexcept {
+				return this->owners_[index];
+			}
+
+			/**
+			 * @brief Returns the current value of a series
+			 */
+			double value(Index index) const noexcept {
+				return this->values_[index];
+			}
+
+			/**
+			 * @brief Returns the previous value of a series
+			 */
+			double previousValue(Index index) const noexcept {
+				return this->previousValues_[index];
+			}
+
+			/**
+			 * @brief Returns the timestamp of a series
+			 */
+			std::chrono::system_clock::time_point timestamp(Index index) const noexcept {
+				return this->timestamps_[index];
+			}
+
+			/**
+			 * @brief Returns the key of the last collection iteration which updated a series
+			 */
+			size_t roundKey(Index index) const noexcept {
+				return this->roundKeys_[index];
+			}
+
+			/**
+			 * @brief Returns the number of the last collection round which updated a series
+			 */
+			size_t updateRound(Index index) const noexcept {
+				return this->updateRounds_[index];
+			}
+
+			/**
+			 * @brief Returns the number of counter resets detected in a series
+			 */
+			uint32_t resetCount(Index index) const noexcept {
+				return this->resetCounts_[index];
+			}
+
+			/**
+			 * @brief Returns the last value of a series given to the delegate
+			 */
+			double emittedValue(Index index) const noexcept {
+				return this->emittedValues_[index];
+			}
+
+			/**
+			 * @brief Returns the number of the collection round which last gave a series to the delegate (-1 if never)
+			 */
+			size_t emittedRound(Index index) const noexcept {
+				return this->emittedRounds_[index];
+			}
+
+			/**
+			 * @brief Returns the difference between the current and previous values of a rate series, before conversion to units per second
+			 */
+			double delta(Index index) const noexcept {
+				return this->values_[index] / this->unitsPerSecondFactors_[index];
+			}
+
+			/**
+			 * @brief Returns a metric object holding the current state of a series
+			 */
+			Metric metric(Index index) const noexcept {
+				return Metric{this->identities_[index], this->values_[index], this->timestamps_[index], this->roundKeys_[index]};
+			}
+
+
+			/**
+			 * @brief Sets a new value to a series
+			 *
+			 * @param index index of the series
+			 * @param value the new value
+			 * @param computeRate whether the rate should be computed (as `value - previousValue`)
+			 * @param unitsPerSecondFactor factor to convert the value into units per seconds (usually the inverse of the time elapsed since the previous value)
+			 */
+			void setNewValue(Index index, double value, bool computeRate, double unitsPerSecondFactor = 1.0) noexcept {
+				if (computeRate)
+					this->values_[index] = value - this->previousValues_[index];
+				else
+					this->values_[index] = value;
+				this->previousValues_[index] = value;
+				this->values_[index] *= unitsPerSecondFactor;
+				this->unitsPerSecondFactors_[index] = unitsPerSecondFactor;
+			}
+
+			/**
+			 * @brief Adds a new value to the current value of a series
+			 *
+			 * When a matcher computes the same metric during a single collection iteration (same round key), the different computed values are summed
+			 *
+			 * @param index index of the series
+			 * @param value The value to add, converted with the same factor as the series' current value
+			 */
+			void updateValue(Index index, double value) noexcept {
+				this->values_[index] += value * this->unitsPerSecondFactors_[index];
+				this->previousValues_[index] += value;
+			}
+
+			/**
+			 * @brief Replaces the difference between the current and previous values of a rate series (for instance after a counter wrap)
+			 */
+			void setDelta(Index index, double delta) noexcept {
+				this->values_[index] = delta * this->unitsPerSecondFactors_[index];
+			}
+
+			/**
+			 * @brief Records that the current value of a series is given to the delegate
+			 */
+			void setEmitted(Index index, size_t round) noexcept {
+				this->emittedValues_[index] = this->values_[index];
+				this->emittedRounds_[index] = round;
+			}
+
+			/**
+			 * @brief Counts a counter reset in a series
+			 */
+			void countReset(Index index) noexcept {
+				this->resetCounts_[index]++;
+			}
+
+			/**
+			 * @brief Sets the previous value of a series, from which its next rate is computed
+			 */
+			void setPreviousValue(Index index, double previousValue) noexcept {
+				this->previousValues_[index] = previousValue;
+			}
+
+			/**
+			 * @brief Sets the timestamp of a series
+			 */
+			void setTimestamp(Index index, std::chrono::system_clock::time_point timestamp) noexcept {
+				this->timestamps_[index] = timestamp;
+			}
+
+			/**
+			 * @brief Sets the key of the last collection iteration which updated a series
+			 */
+			void setRoundKey(Index index, size_t roundKey) noexcept {
+				this->roundKeys_[index] = roundKey;
+			}
+
+			/**
+			 * @brief Sets the number of the last collection round which updated a series
+			 */
+			void setUpdateRound(Index index, size_t round) noexcept {
+				this->updateRounds_[index] = round;
+			}
+
+			/**
+			 * @brief Sets the matcher which created a series (used when matchers are replaced by a config reload)
+			 */
+			void setOwner(Index index, Matcher* owner) noexcept {
+				this->owners_[index] = owner;
+			}
+	};
+}
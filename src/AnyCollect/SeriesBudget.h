@@ -0,0 +1,42 @@
+//
+// SeriesBudget.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+
+
+namespace AnyCollect {
+	/**
+	 * @brief Struct used to limit the number of series created by a matcher or an expression
+	 */
+	struct SeriesBudget {
+		size_t maxSeries = 0;				//!< Maximum number of series (0 for no limit)
+		size_t seriesCount = 0;				//!< Number of series currently accounted to the budget
+		size_t rejectedSeriesCount = 0;		//!< Number of distinct new series rejected because the budget was exhausted
+
+		/**
+		 * @brief Returns whether no more series can be created
+		 */
+		bool isExhausted() const noexcept {
+			return this->maxSeries != 0 && this->seriesCount >= this->maxSeries;
+		}
+	};
+}
@@ -0,0 +1,195 @@
+//
+// SeriesHistory.cc
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+
+#include "SeriesHistory.h"
+
+
+namespace AnyCollect {
+	SeriesHistory::SeriesHistory() noexcept :
+		seriesCount_(0)
+	{ }
+
+
+	void SeriesHistory::resizeLevel(Level& level, size_t seriesCount) {
+		size_t size = seriesCount * level.resolution.size;
+		level.timestamps.resize(size);
+		level.lasts.resize(size);
+		if (!level.isRaw()) {
+			level.mins.resize(size);
+			level.maxs.resize(size);
+			level.sums.resize(size);
+			level.counts.resize(size);
+		}
+		level.heads.resize(seriesCount, 0);
+		level.sizes.resize(seriesCount, 0);
+	}
+
+
+	std::vector<SeriesHistory::Resolution> SeriesHistory::resolutions() const noexcept {
+		std::vector<Resolution> resolutions;
+		for (const auto& level : this->levels_)
+			resolutions.push_back(level.resolution);
+		return resolutions;
+	}
+
+	void SeriesHistory::setResolutions(std::vector<Resolution> resolutions, size_t seriesCount) {
+		resolutions.erase(std::remove_if(resolutions.begin(), resolutions.end(), [](const Resolution& resolution) {
+			return resolution.size == 0 || resolution.interval.count() < 0;
+		}), resolutions.end());
+		std::sort(resolutions.begin(), resolutions.end(), [](const Resolution& lhs, const Resolution& rhs) {
+			return lhs.interval < rhs.interval;
+		});
+
+		this->levels_.clear();
+		this->seriesCount_ = seriesCount;
+		for (const auto& resolution : resolutions) {
+			this->levels_.push_back(Level{resolution, {}, {}, {}, {}, {}, {}, {}, {}});
+			SeriesHistory::resizeLevel(this->levels_.back(), seriesCount);
+		}
+	}
+
+
+	void SeriesHistory::resize(size_t seriesCount) {
+		this->seriesCount_ = seriesCount;
+		for (auto& level : this->levels_)
+			SeriesHistory::resizeLevel(level, seriesCount);
+	}
+
+	void SeriesHistory::reserve(size_t seriesCount) {
+		for (auto& level : this->levels_) {
+			size_t size = seriesCount * level.resolution.size;
+			level.timestamps.reserve(size);
+			level.lasts.reserve(size);
+			if (!level.isRaw()) {
+				level.mins.reserve(size);
+				level.maxs.reserve(size);
+				level.sums.reserve(size);
+				level.counts.reserve(size);
+			}
+			level.heads.reserve(seriesCount);
+			level.sizes.reserve(seriesCount);
+		}
+	}
+
+	void SeriesHistory::moveSeries(Index from, Index to) noexcept {
+		for (auto& level : this->levels_) {
+			size_t size = level.resolution.size;
+			auto move = [&](auto& column) {
+				std::copy_n(column.begin() + from * size, size, column.begin() + to * size);
+			};
+			move(level.timestamps);
+			move(level.lasts);
+			if (!level.isRaw()) {
+				move(level.mins);
+				move(level.maxs);
+				move(level.sums);
+				move(level.counts);
+			}
+			level.heads[to] = level.heads[from];
+			level.sizes[to] = level.sizes[from];
+		}
+	}
+
+	void SeriesHistory::truncate(size_t seriesCount) {
+		this->resize(seriesCount);
+		for (auto& level : this->levels_) {
+			if (level.heads.capacity() > 4 * seriesCount) {
+				level.timestamps.shrink_to_fit();
+				level.lasts.shrink_to_fit();
+				level.mins.shrink_to_fit();
+				level.maxs.shrink_to_fit();
+				level.sums.shrink_to_fit();
+				level.counts.shrink_to_fit();
+				level.heads.shrink_to_fit();
+				level.sizes.shrink_to_fit();
+			}
+		}
+	}
+
+
+	void SeriesHistory::append(Index index, std::chrono::system_clock::time_point timestamp, double value) noexcept {
+		for (auto& level : this->levels_) {
+			size_t size = level.resolution.size;
+			size_t base = index * size;
+			uint32_t& head = level.heads[index];
+			uint32_t& count = level.sizes[index];
+
+			auto bucketStart = timestamp;
+			if (!level.isRaw()) {
+				bucketStart -= timestamp.time_since_epoch() % level.resolution.interval;
+				if (count > 0 && level.timestamps[base + head] == bucketStart) {
+					size_t slot = base + head;
+					level.mins[slot] = std::min(level.mins[slot], value);
+					level.maxs[slot] = std::max(level.maxs[slot], value);
+					level.sums[slot] += value;
+					level.lasts[slot] = value;
+					level.counts[slot]++;
+					continue;
+				}
+			}
+
+			// Start a new point, overwriting the oldest one if the ring is full
+			if (count > 0)
+				head = static_cast<uint32_t>((head + 1) % size);
+			count = static_cast<uint32_t>(std::min<size_t>(count + 1, size));
+			size_t slot = base + head;
+			level.timestamps[slot] = bucketStart;
+			level.lasts[slot] = value;
+			if (!level.isRaw()) {
+				level.mins[slot] = value;
+				level.maxs[slot] = value;
+				level.sums[slot] = value;
+				level.counts[slot] = 1;
+			}
+		}
+	}
+
+	std::vector<SeriesHistory::Point> SeriesHistory::query(Index index, std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to, std::chrono::seconds interval) const {
+		if (this->levels_.empty() || index >= this->seriesCount_)
+			return {};
+
+		const Level* level = &this->levels_.front();
+		for (const auto& candidate : this->levels_) {
+			if (candidate.resolution.interval <= interval)
+				level = &candidate;
+		}
+
+		std::vector<Point> points;
+		size_t size = level->resolution.size;
+		size_t base = index * size;
+		size_t count = level->sizes[index];
+		size_t oldest = (level->heads[index] + size + 1 - count) % size;
+		for (size_t i = 0; i < count; i++) {
+			size_t slot = base + (oldest + i) % size;
+			auto timestamp = level->timestamps[slot];
+			if (timestamp > to || (level->isRaw() ? timestamp < from : timestamp + level->resolution.interval <= from))
+				continue;
+			if (level->isRaw()) {
+				double value = level->lasts[slot];
+				points.push_back(Point{timestamp, value, value, value, value, 1});
+			} else {
+				points.push_back(Point{timestamp, level->mins[slot], level->maxs[slot], level->sums[slot] / level->counts[slot], level->lasts[slot], level->counts[slot]});
+			}
+		}
+		return points;
+	}
+}
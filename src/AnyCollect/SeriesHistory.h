@@ -0,0 +1,170 @@
+//
+// SeriesHistory.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+
+namespace AnyCollect {
+	/**
+	 * @brief Class used to keep the recent history of every series, at several resolutions
+	 *
+	 * Each resolution (level) keeps a fixed-size ring of points per series. The first level holds raw samples, the following ones hold rollups (min, max, average and last value) over fixed time buckets. Rollups are updated incrementally as samples are appended: each sample only touches the current bucket of each level.
+	 *
+	 * Rings are stored as columns shared by all series: the ring of series `i` occupies slots `[i * size, (i + 1) * size)` of each column of its level. Series indexes are the ones of `MetricStore`, which keeps them in sync.
+	 */
+	class SeriesHistory {
+		public:
+			using Index = uint32_t;														//!< Type of series indexes
+
+			/**
+			 * @brief Resolution of a history level
+			 */
+			struct Resolution {
+				std::chrono::seconds interval;											//!< Duration of a bucket (0 for raw samples)
+				size_t size;															//!< Number of points kept per series
+			};
+
+			/**
+			 * @brief Point of a series history
+			 */
+			struct Point {
+				std::chrono::system_clock::time_point timestamp;						//!< Timestamp of the sample, or start of the bucket
+				double min;																//!< Minimum value in the bucket
+				double max;																//!< Maximum value in the bucket
+				double average;															//!< Average value in the bucket
+				double last;															//!< Last value in the bucket
+				uint32_t count;															//!< Number of samples in the bucket
+			};
+
+		protected:
+			/**
+			 * @brief Rings of all series at one resolution
+			 *
+			 * Raw levels only use the `timestamps` and `lasts` columns.
+			 */
+			struct Level {
+				Resolution resolution;													//!< Resolution of the level
+				std::vector<std::chrono::system_clock::time_point> timestamps;			//!< Column of sample timestamps or bucket starts
+				std::vector<double> mins;												//!< Column of bucket minimums
+				std::vector<double> maxs;												//!< Column of bucket maximums
+				std::vector<double> sums;												//!< Column of bucket sums
+				std::vector<double> lasts;												//!< Column of last values
+				std::vector<uint32_t> counts;											//!< Column of bucket sample counts
+				std::vector<uint32_t> heads;											//!< Per series position of the most recent point in its ring
+				std::vector<uint32_t> sizes;											//!< Per series number of points in its ring
+
+				/**
+				 * @brief Returns whether the level holds raw samples
+				 */
+				bool isRaw() const noexcept {
+					return this->resolution.interval.count() == 0;
+				}
+			};
+
+			std::vector<Level> levels_;													//!< History levels, raw samples first, then by increasing interval
+			size_t seriesCount_;														//!< Number of series with a history
+
+			/**
+			 * @brief Resizes every column of a level to hold a number of series
+			 */
+			static void resizeLevel(Level& level, size_t seriesCount);
+
+		public:
+			/**
+			 * @brief Construct a new SeriesHistory object without any level
+			 */
+			SeriesHistory() noexcept;
+
+
+			/**
+			 * @brief Returns whether history is kept
+			 */
+			bool isEnabled() const noexcept {
+				return !this->levels_.empty();
+			}
+
+			/**
+			 * @brief Returns the resolutions of the history levels
+			 */
+			std::vector<Resolution> resolutions() const noexcept;
+
+			/**
+			 * @brief Sets the resolutions of the history levels, dropping any recorded history
+			 *
+			 * Resolutions with a null size are ignored. Levels are sorted by increasing interval.
+			 *
+			 * @param resolutions the levels to keep (empty to disable history)
+			 * @param seriesCount the current number of series
+			 */
+			void setResolutions(std::vector<Resolution> resolutions, size_t seriesCount);
+
+
+			/**
+			 * @brief Adds empty histories for new series
+			 *
+			 * @param seriesCount the new number of series
+			 */
+			void resize(size_t seriesCount);
+
+			/**
+			 * @brief Reserves memory for a number of series
+			 */
+			void reserve(size_t seriesCount);
+
+			/**
+			 * @brief Moves the history of a series to a lower index, overwriting the history at that index
+			 */
+			void moveSeries(Index from, Index to) noexcept;
+
+			/**
+			 * @brief Drops the history of every series after the specified number
+			 */
+			void truncate(size_t seriesCount);
+
+
+			/**
+			 * @brief Appends a sample to the history of a series, updating the current bucket of every rollup level
+			 *
+			 * Samples are expected in increasing timestamp order.
+			 *
+			 * @param index index of the series
+			 * @param timestamp timestamp of the sample
+			 * @param value value of the sample
+			 */
+			void append(Index index, std::chrono::system_clock::time_point timestamp, double value) noexcept;
+
+			/**
+			 * @brief Returns the points of a series history within a time range, oldest first
+			 *
+			 * The coarsest level whose interval is not larger than the requested one is used.
+			 *
+			 * @param index index of the series
+			 * @param from beginning of the time range (included)
+			 * @param to end of the time range (included)
+			 * @param interval requested resolution (0 for raw samples)
+			 * @return the points of the series in the time range
+			 */
+			std::vector<Point> query(Index index, std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to, std::chrono::seconds interval) const;
+	};
+}
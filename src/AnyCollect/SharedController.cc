@@ -0,0 +1,225 @@
+//
+// SharedController.cc
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "SharedController.h"
+
+
+namespace AnyCollect {
+	std::mutex SharedController::sharedControllersMutex_;
+	std::map<std::string, std::weak_ptr<SharedController>> SharedController::sharedControllers_;
+
+
+	SharedController::SharedController(const std::string& configPath) :
+		configPath_(configPath),
+		controller_(*this),
+		iterationCount_(0)
+	{ }
+
+	SharedController::~SharedController() {
+		// Subscribers' state must outlive the collection thread
+		this->controller_.stop();
+		this->controller_.join();
+	}
+
+	std::shared_ptr<SharedController> SharedController::forConfig(const std::string& configPath) {
+		std::lock_guard<std::mutex> lock(SharedController::sharedControllersMutex_);
+		auto& sharedController = SharedController::sharedControllers_[configPath];
+		auto controller = sharedController.lock();
+		if (controller == nullptr) {
+			controller = std::make_shared<SharedController>(configPath);
+			sharedController = controller;
+		}
+
+		// Forget the configs which are not shared anymore
+		for (auto itr = SharedController::sharedControllers_.begin(); itr != SharedController::sharedControllers_.end();) {
+			if (itr->second.expired())
+				itr = SharedController::sharedControllers_.erase(itr);
+			else
+				itr++;
+		}
+		return controller;
+	}
+
+
+	std::vector<SharedController::Subscriber>::iterator SharedController::findSubscriber(const ControllerDelegate& delegate) noexcept {
+		return std::find_if(this->subscribers_.begin(), this->subscribers_.end(), [&](const auto& subscriber) {
+			return subscriber.delegate == &delegate;
+		});
+	}
+
+	void SharedController::updateMatcherFilter() {
+		std::vector<std::function<bool(const Matcher&)>> matcherFilters;
+		for (const auto& subscriber : this->subscribers_) {
+			if (!subscriber.matcherFilter) {
+				this->controller_.setMatcherFilter(nullptr);
+				return;
+			}
+			matcherFilters.push_back(subscriber.matcherFilter);
+		}
+		this->controller_.setMatcherFilter([matcherFilters](const Matcher& matcher) {
+			return std::any_of(matcherFilters.begin(), matcherFilters.end(), [&](const auto& matcherFilter) {
+				return matcherFilter(matcher);
+			});
+		});
+	}
+
+	std::vector<ControllerDelegate*> SharedController::callSubscribers(const std::function<bool(const Subscriber&)>& selects, const std::function<bool(ControllerDelegate&)>& call) {
+		std::vector<ControllerDelegate*> delegates;
+		{
+			std::lock_guard<std::mutex> lock(this->subscribersMutex_);
+			for (const auto& subscriber : this->subscribers_) {
+				if (selects(subscriber))
+					delegates.push_back(subscriber.delegate);
+			}
+		}
+
+		// Delegates are called without the lock, so that subscribers can come and go meanwhile: removing one waits for its call in progress, if any, and skips its pending ones
+		std::vector<ControllerDelegate*> results;
+		for (auto* delegate : delegates) {
+			{
+				std::lock_guard<std::mutex> lock(this->subscribersMutex_);
+				if (this->findSubscriber(*delegate) == this->subscribers_.end())
+					continue;
+				this->calledDelegates_.push_back(delegate);
+			}
+			if (call(*delegate))
+				results.push_back(delegate);
+			{
+				std::lock_guard<std::mutex> lock(this->subscribersMutex_);
+				this->calledDelegates_.erase(std::find(this->calledDelegates_.begin(), this->calledDelegates_.end(), delegate));
+			}
+			this->subscribersCondition_.notify_all();
+		}
+		return results;
+	}
+
+
+	bool SharedController::configure(const std::function<void(Controller&)>& configure) {
+		std::lock_guard<std::mutex> lock(this->subscribersMutex_);
+		if (this->controller_.isCollecting())
+			return false;
+		// The config is loaded once configured, since some settings (such as the config cache) apply when loading it
+		configure(this->controller_);
+		return this->controller_.loadConfigFromFile(this->configPath_);
+	}
+
+	size_t SharedController::subscriberCount() {
+		std::lock_guard<std::mutex> lock(this->subscribersMutex_);
+		return this->subscribers_.size();
+	}
+
+	bool SharedController::subscribe(ControllerDelegate& delegate, std::chrono::milliseconds interval, std::function<bool(const Matcher&)> matcherFilter) {
+		std::lock_guard<std::mutex> lock(this->subscribersMutex_);
+		if (this->findSubscriber(delegate) != this->subscribers_.end())
+			return false;
+
+		size_t iterationInterval = 1;
+		auto samplingInterval = this->controller_.samplingInterval();
+		if (samplingInterval.count() > 0)
+			iterationInterval = std::max<long long>(std::llround(static_cast<double>(interval.count()) / samplingInterval.count()), 1);
+		this->subscribers_.push_back({&delegate, iterationInterval, this->iterationCount_, std::move(matcherFilter)});
+		this->updateMatcherFilter();
+
+		if (!this->controller_.isCollecting() && !this->controller_.start()) {
+			std::cerr << this->configPath_ << ": Shared controller cannot collect metrics." << std::endl;
+			this->subscribers_.pop_back();
+			this->updateMatcherFilter();
+			return false;
+		}
+		return true;
+	}
+
+	void SharedController::unsubscribe(ControllerDelegate& delegate) {
+		std::unique_lock<std::mutex> lock(this->subscribersMutex_);
+		auto itr = this->findSubscriber(delegate);
+		if (itr != this->subscribers_.end()) {
+			this->subscribers_.erase(itr);
+			this->updateMatcherFilter();
+			this->subscribersCondition_.notify_all();
+		}
+		this->subscribersCondition_.wait(lock, [&] {
+			return std::find(this->calledDelegates_.begin(), this->calledDelegates_.end(), &delegate) == this->calledDelegates_.end();
+		});
+	}
+
+	void SharedController::run(ControllerDelegate& delegate, std::chrono::milliseconds interval, std::function<bool(const Matcher&)> matcherFilter) {
+		if (!this->subscribe(delegate, interval, std::move(matcherFilter)))
+			return;
+		std::unique_lock<std::mutex> lock(this->subscribersMutex_);
+		this->subscribersCondition_.wait(lock, [&] {
+			return this->findSubscriber(delegate) == this->subscribers_.end() && std::find(this->calledDelegates_.begin(), this->calledDelegates_.end(), &delegate) == this->calledDelegates_.end();
+		});
+	}
+
+
+	void SharedController::contollerCollectedMetrics(const Controller& controller, const std::vector<const Metric*>& metrics) {
+		// Subscribers which joined after this iteration started wait for the next one
+		size_t iteration = this->iterationCount_++;
+		this->callSubscribers([&](const Subscriber& subscriber) {
+			return iteration >= subscriber.firstIteration && (iteration - subscriber.firstIteration) % subscriber.iterationInterval == 0;
+		}, [&](ControllerDelegate& delegate) {
+			delegate.contollerCollectedMetrics(controller, metrics);
+			return false;
+		});
+	}
+
+	bool SharedController::contollerShouldStopCollectingMetrics(const Controller& controller) {
+		auto stoppedDelegates = this->callSubscribers([](const Subscriber&) {
+			return true;
+		}, [&](ControllerDelegate& delegate) {
+			return delegate.contollerShouldStopCollectingMetrics(controller);
+		});
+		if (!stoppedDelegates.empty()) {
+			std::lock_guard<std::mutex> lock(this->subscribersMutex_);
+			for (auto* delegate : stoppedDelegates) {
+				auto itr = this->findSubscriber(*delegate);
+				if (itr != this->subscribers_.end())
+					this->subscribers_.erase(itr);
+			}
+			this->updateMatcherFilter();
+			this->subscribersCondition_.notify_all();
+		}
+
+		// Keep collecting without subscribers, new ones may come as long as the shared controller is referenced
+		return false;
+	}
+
+	void SharedController::contollerEvictedMetrics(const Controller& controller, const std::vector<Key>& keys) {
+		this->callSubscribers([](const Subscriber&) {
+			return true;
+		}, [&](ControllerDelegate& delegate) {
+			delegate.contollerEvictedMetrics(controller, keys);
+			return false;
+		});
+	}
+
+	bool SharedController::contollerCanPublishMetrics(const Controller& controller) {
+		auto blockedDelegates = this->callSubscribers([](const Subscriber&) {
+			return true;
+		}, [&](ControllerDelegate& delegate) {
+			return !delegate.contollerCanPublishMetrics(controller);
+		});
+		return blockedDelegates.empty();
+	}
+}
@@ -0,0 +1,165 @@
+//
+// SharedController.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Controller.h"
+
+using namespace std::literals;
+
+
+namespace AnyCollect {
+	/**
+	 * @brief Class sharing the controller collecting the metrics of a config between the delegates of a process, called subscribers
+	 *
+	 * Sources are read and matched once per iteration, however many subscribers there are. Each subscriber is given the metrics of every n-th iteration, and selects the matchers it needs: the controller only evaluates the matchers selected by at least one subscriber. Subscribers still get every metric of their iterations, and should ignore the ones they did not ask for.
+	 *
+	 * The controller starts collecting with the first subscriber, and stops when the shared controller is destroyed. Subscribers are called from the collection thread (or the delivery thread, if the dispatch queue is enabled), without any lock held, so that a slow subscriber only delays the others.
+	 */
+	class SharedController final : public ControllerDelegate {
+		protected:
+			/**
+			 * @brief Structure describing a subscriber
+			 */
+			struct Subscriber {
+				ControllerDelegate* delegate;								//!< Delegate given the metrics
+				size_t iterationInterval;									//!< Number of iterations between two deliveries of metrics
+				size_t firstIteration;										//!< Index of the first iteration given to the subscriber
+				std::function<bool(const Matcher&)> matcherFilter;			//!< Predicate selecting the matchers the subscriber needs (all of them if empty)
+			};
+
+			static std::mutex sharedControllersMutex_;										//!< Mutex protecting `sharedControllers_`
+			static std::map<std::string, std::weak_ptr<SharedController>> sharedControllers_;	//!< Map associating config paths to their shared controller, if any
+
+			std::string configPath_;										//!< Path of the config file collected
+			Controller controller_;											//!< Controller collecting metrics for all subscribers
+			std::mutex subscribersMutex_;									//!< Mutex protecting the subscribers and the delegates being called
+			std::condition_variable subscribersCondition_;					//!< Condition notified when subscribers are removed or calls to them end
+			std::vector<Subscriber> subscribers_;							//!< Array of subscribers
+			std::vector<ControllerDelegate*> calledDelegates_;				//!< Array of the delegates being called, once per call in progress
+			std::atomic<size_t> iterationCount_;							//!< Number of iterations given to subscribers
+
+			/**
+			 * @brief Returns the subscriber of a delegate, or the end of `subscribers_` (`subscribersMutex_` must be locked)
+			 */
+			std::vector<Subscriber>::iterator findSubscriber(const ControllerDelegate& delegate) noexcept;
+
+			/**
+			 * @brief Gives the controller a matcher filter selecting the matchers needed by at least one subscriber (`subscribersMutex_` must be locked)
+			 */
+			void updateMatcherFilter();
+
+			/**
+			 * @brief Calls some subscribers, without holding `subscribersMutex_` during the calls
+			 *
+			 * @param selects predicate selecting the subscribers to call, given each subscriber with `subscribersMutex_` locked
+			 * @param call function calling a subscriber's delegate
+			 * @return the delegates for which `call` returned *true*
+			 */
+			std::vector<ControllerDelegate*> callSubscribers(const std::function<bool(const Subscriber&)>& selects, const std::function<bool(ControllerDelegate&)>& call);
+
+		public:
+			/**
+			 * @brief Construct a new Shared Controller object, which loads its config once configured
+			 *
+			 * @param configPath path of the config file to collect
+			 */
+			SharedController(const std::string& configPath);
+
+			/**
+			 * @brief Destroy the Shared Controller object, stopping the collection
+			 */
+			~SharedController();
+
+			/**
+			 * @brief Returns the shared controller of a config, creating it if needed
+			 *
+			 * The shared controller lives as long as it is referenced, so that later callers with the same config share it.
+			 *
+			 * @param configPath path of the config file
+			 * @return the shared controller of the config
+			 */
+			static std::shared_ptr<SharedController> forConfig(const std::string& configPath);
+
+
+			/**
+			 * @brief Configures the controller and loads the config, unless it is already collecting for other subscribers
+			 *
+			 * The sampling interval set then is the base iteration of all subscribers.
+			 *
+			 * @param configure function configuring the controller
+			 * @return *true* if the controller was configured
+			 * @return *false* if it is already collecting, with the settings of the first subscriber, or the config could not be loaded
+			 */
+			bool configure(const std::function<void(Controller&)>& configure);
+
+			/**
+			 * @brief Returns the number of subscribers
+			 */
+			size_t subscriberCount();
+
+			/**
+			 * @brief Adds a subscriber, starting the collection if needed
+			 *
+			 * @param delegate delegate given the metrics, until its `contollerShouldStopCollectingMetrics` returns *true* or it is unsubscribed
+			 * @param interval interval between two deliveries of metrics, rounded to a multiple of the controller's sampling interval (and at least one iteration)
+			 * @param matcherFilter predicate selecting the matchers the subscriber needs (empty for all of them)
+			 * @return *true* if the subscriber was added
+			 * @return *false* if it was already subscribed, or if the controller cannot collect metrics
+			 */
+			bool subscribe(ControllerDelegate& delegate, std::chrono::milliseconds interval, std::function<bool(const Matcher&)> matcherFilter = nullptr);
+
+			/**
+			 * @brief Removes a subscriber, which is not called anymore once this returns
+			 *
+			 * This waits for the calls to the subscriber in progress, so it must not be called from the subscriber's own callbacks.
+			 *
+			 * @param delegate delegate of the subscriber
+			 */
+			void unsubscribe(ControllerDelegate& delegate);
+
+			/**
+			 * @brief Adds a subscriber and waits until its `contollerShouldStopCollectingMetrics` returns *true* or it is unsubscribed, like `Controller::collectMetrics`
+			 *
+			 * Once this returns, the subscriber is not called anymore.
+			 *
+			 * @param delegate delegate given the metrics
+			 * @param interval interval between two deliveries of metrics, rounded to a multiple of the controller's sampling interval
+			 * @param matcherFilter predicate selecting the matchers the subscriber needs (empty for all of them)
+			 */
+			void run(ControllerDelegate& delegate, std::chrono::milliseconds interval, std::function<bool(const Matcher&)> matcherFilter = nullptr);
+
+
+			void contollerCollectedMetrics(const Controller& controller, const std::vector<const Metric*>& metrics) override final;
+			bool contollerShouldStopCollectingMetrics(const Controller& controller) override final;
+			void contollerEvictedMetrics(const Controller& controller, const std::vector<Key>& keys) override final;
+			bool contollerCanPublishMetrics(const Controller& controller) override final;
+	};
+}
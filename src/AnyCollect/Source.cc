@@ -30,7 +30,9 @@ namespace fs = boost::filesystem;
 namespace AnyCollect {
 	Source::Source(const std::string& filePath) noexcept :
 		type_(SourceTypeFile),
-		path_(filePath)
+		path_(filePath),
+		isEnabled_(true),
+		readRoundKey_(0)
 	{
 		fs::path fspath{this->path_};
 		for (const auto& pathPart : fspath.relative_path())
@@ -39,8 +41,13 @@ namespace AnyCollect {
 	}
 
 	Source::Source(const std::string& program, const std::vector<std::string>& arguments) noexcept :
-		type_(SourceTypeCommand)
+		type_(SourceTypeCommand),
+		isEnabled_(true),
+		readRoundKey_(0)
 	{
+		this->commandLine_.reserve(arguments.size() + 1);
+		this->commandLine_.push_back(program);
+		this->commandLine_.insert(this->commandLine_.end(), arguments.begin(), arguments.end());
 		this->path_ = program;
 		for (const auto& arg : arguments)
 			this->path_ += " " + arg;
@@ -77,6 +84,10 @@ namespace AnyCollect {
 		return this->pathParts_;
 	}
 
+	const std::vector<std::string>& Source::commandLine() const noexcept {
+		return this->commandLine_;
+	}
+
 	const std::string_view& Source::contents() const noexcept {
 		return this->contents_;
 	}
@@ -93,6 +104,26 @@ namespace AnyCollect {
 		return this->expressions_;
 	}
 
+	bool Source::isEnabled() const noexcept {
+		return this->isEnabled_;
+	}
+
+	Source::Statistics& Source::statistics() noexcept {
+		return this->statistics_;
+	}
+
+	void Source::setEnabled(bool isEnabled) noexcept {
+		this->isEnabled_ = isEnabled;
+	}
+
+	size_t Source::readRoundKey() const noexcept {
+		return this->readRoundKey_;
+	}
+
+	void Source::setReadRoundKey(size_t roundKey) noexcept {
+		this->readRoundKey_ = roundKey;
+	}
+
 
 	size_t Source::readFile(bool firstTime) {
 		errno = 0;
@@ -46,10 +46,19 @@ namespace AnyCollect {
 				SourceTypeCommand,		//!< Command output source
 			};
 
+			/**
+			 * @brief Statistics about the source's last reading since they were last reported, kept when self metrics are enabled
+			 */
+			struct Statistics {
+				std::chrono::nanoseconds readDuration{0};		//!< Time spent reading the file or executing the command
+				size_t readSize = 0;							//!< Number of bytes read
+			};
+
 		protected:
 			SourceType type_;											//!< The type of the source
 			std::string path_;											//!< Path of the file or command to execute
 			std::vector<std::string> pathParts_;						//!< For file sources, the parts of the file's path
+			std::vector<std::string> commandLine_;						//!< For command sources, the program followed by its arguments
 			std::ifstream file_;										//!< For file sources, the file descriptor
 			redi::ipstream process_;									//!< For command sources, the child process
 			std::vector<char> buffer_;									//!< Buffer for file contents or command output
@@ -58,6 +67,9 @@ namespace AnyCollect {
 			std::chrono::system_clock::time_point timestamp_;			//!< Last contents or output fetching time
 
 			std::vector<std::shared_ptr<Expression>> expressions_;		//!< Array of expressions used on the source's contents
+			bool isEnabled_;											//!< Whether the source is read
+			Statistics statistics_;										//!< Statistics about the source's last reading
+			size_t readRoundKey_;										//!< Round key of the controller iteration that last read the source (0 if never read)
 
 			size_t readFile(bool firstTime = false);					//!< For file sources, put the file contents into the buffer_
 			size_t executeCommand(bool firstTime = false);				//!< For command sources, put the command output into the buffer_
@@ -103,6 +115,11 @@ namespace AnyCollect {
 			 */
 			const std::vector<std::string>& pathParts() const noexcept;
 
+			/**
+			 * @brief For command sources, returns the program followed by its arguments
+			 */
+			const std::vector<std::string>& commandLine() const noexcept;
+
 			/**
 			 * @brief Returns the stored contents (file contents or command output)
 			 */
@@ -123,6 +140,31 @@ namespace AnyCollect {
 			 */
 			const std::vector<std::shared_ptr<Expression>>& expressions() const noexcept;
 
+			/**
+			 * @brief Returns whether the source is read
+			 */
+			bool isEnabled() const noexcept;
+
+			/**
+			 * @brief Returns the statistics about the source's last reading
+			 */
+			Statistics& statistics() noexcept;
+
+			/**
+			 * @brief Returns the round key of the controller iteration that last read the source (0 if never read)
+			 */
+			size_t readRoundKey() const noexcept;
+
+			/**
+			 * @brief Sets the round key of the controller iteration reading the source
+			 */
+			void setReadRoundKey(size_t roundKey) noexcept;
+
+			/**
+			 * @brief Sets whether the source is read
+			 */
+			void setEnabled(bool isEnabled) noexcept;
+
 
 			/**
 			 * @brief Resets the source: attempts to open the file or execute the command, allocates enough space for contents
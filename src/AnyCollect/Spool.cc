@@ -0,0 +1,181 @@
+//
+// Spool.cc
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+
+#include <boost/filesystem.hpp>
+
+#include "Spool.h"
+
+namespace fs = boost::filesystem;
+
+
+namespace AnyCollect {
+	Spool::Spool(const std::string& directory, size_t segmentSize, size_t maxSegmentCount) :
+		directory_(directory),
+		segmentSize_(segmentSize),
+		maxSegmentCount_(std::max<size_t>(maxSegmentCount, 2)),
+		hasCurrentSegment_(false),
+		nextSequence_(0),
+		droppedRoundCount_(0)
+	{
+		boost::system::error_code error;
+		fs::create_directories(this->directory_, error);
+		if (error) {
+			std::cerr << this->directory_ << ": Error creating spool directory: " << error.message() << std::endl;
+			return;
+		}
+
+		// Load segments left over by a previous process, oldest first
+		std::vector<std::pair<uint64_t, std::string>> paths;
+		for (const auto& entry : fs::directory_iterator(this->directory_, error)) {
+			if (entry.path().extension() != std::string(Spool::segmentExtension))
+				continue;
+			std::string stem = entry.path().stem().string();
+			char* end = nullptr;
+			uint64_t sequence = std::strtoull(stem.c_str(), &end, 10);
+			if (stem.empty() || *end != '\0')
+				continue;
+			paths.emplace_back(sequence, entry.path().string());
+			this->nextSequence_ = std::max(this->nextSequence_, sequence + 1);
+		}
+		std::sort(paths.begin(), paths.end());
+		for (const auto& path : paths) {
+			auto segment = SpoolSegment::open(path.second);
+			if (segment == nullptr)
+				continue;
+			if (segment->pendingRoundCount() == 0)
+				segment->remove();
+			else
+				this->segments_.push_back(std::move(segment));
+		}
+		while (this->segments_.size() > this->maxSegmentCount_)
+			this->dropOldestSegment();
+	}
+
+
+	std::string Spool::segmentPath(uint64_t sequence) const {
+		char name[32];
+		snprintf(name, sizeof(name), "%016llu", static_cast<unsigned long long>(sequence));
+		return (fs::path{this->directory_} / (std::string(name) + std::string(Spool::segmentExtension))).string();
+	}
+
+	bool Spool::startSegment() {
+		while (this->segments_.size() >= this->maxSegmentCount_)
+			this->dropOldestSegment();
+		auto segment = SpoolSegment::create(this->segmentPath(this->nextSequence_++), this->segmentSize_);
+		if (segment == nullptr)
+			return false;
+		this->segments_.push_back(std::move(segment));
+		this->hasCurrentSegment_ = true;
+		return true;
+	}
+
+	void Spool::dropOldestSegment() noexcept {
+		auto& segment = this->segments_.front();
+		if (segment->pendingRoundCount() > 0)
+			std::cerr << "Spool is full, dropping " << segment->pendingRoundCount() << " unpublished rounds." << std::endl;
+		this->droppedRoundCount_ += segment->pendingRoundCount();
+		segment->remove();
+		this->segments_.pop_front();
+		if (this->segments_.empty())
+			this->hasCurrentSegment_ = false;
+	}
+
+
+	const std::string& Spool::directory() const noexcept {
+		return this->directory_;
+	}
+
+	size_t Spool::pendingRoundCount() const noexcept {
+		size_t count = 0;
+		for (const auto& segment : this->segments_)
+			count += segment->pendingRoundCount();
+		return count;
+	}
+
+	size_t Spool::droppedRoundCount() const noexcept {
+		return this->droppedRoundCount_;
+	}
+
+
+	bool Spool::append(const std::vector<Metric>& metrics) {
+		if (this->hasCurrentSegment_ && this->segments_.back()->append(metrics))
+			return true;
+
+		// The current segment is full (or there is none): start a new one
+		this->hasCurrentSegment_ = false;
+		if (this->startSegment()) {
+			if (this->segments_.back()->append(metrics))
+				return true;
+			// The round does not even fit in an empty segment
+			this->segments_.back()->remove();
+			this->segments_.pop_back();
+			this->hasCurrentSegment_ = false;
+		}
+		this->droppedRoundCount_++;
+		return false;
+	}
+
+	bool Spool::replay(const std::function<bool(const std::vector<Metric>&)>& consumer, size_t batchSize) {
+		if (this->hasCurrentSegment_) {
+			this->segments_.back()->seal();
+			this->hasCurrentSegment_ = false;
+		}
+
+		std::vector<Metric> batch;
+		while (!this->segments_.empty()) {
+			auto& segment = *this->segments_.front();
+			bool isAccepted = true;
+			size_t batchEnd = 0;
+			bool isDecoded = segment.forEachPendingRound([&](size_t round, std::vector<Metric>&& metrics) {
+				batch.insert(batch.end(), std::make_move_iterator(metrics.begin()), std::make_move_iterator(metrics.end()));
+				batchEnd = round + 1;
+				if (batch.size() < batchSize)
+					return true;
+				isAccepted = consumer(batch);
+				if (!isAccepted)
+					return false;
+				segment.setReplayedRoundCount(batchEnd);
+				batch.clear();
+				return true;
+			});
+			if (isAccepted && !batch.empty()) {
+				isAccepted = consumer(batch);
+				if (isAccepted)
+					segment.setReplayedRoundCount(batchEnd);
+			}
+			batch.clear();
+			if (!isAccepted)
+				return false;
+
+			if (!isDecoded) {
+				std::cerr << segment.path() << ": Corrupted spool segment, dropping " << segment.pendingRoundCount() << " unpublished rounds." << std::endl;
+				this->droppedRoundCount_ += segment.pendingRoundCount();
+			}
+			segment.remove();
+			this->segments_.pop_front();
+		}
+		return true;
+	}
+}
@@ -0,0 +1,120 @@
+//
+// Spool.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Metric.h"
+#include "SpoolSegment.h"
+
+using namespace std::literals;
+
+
+namespace AnyCollect {
+	/**
+	 * @brief Class used to keep collection rounds on disk while they cannot be published, and replay them later
+	 *
+	 * Rounds are appended to the current segment of a directory of fixed-size segment files (see `SpoolSegment`). When it is full, a new segment is started. Disk use is bounded by a maximum number of segments: when it is reached, the oldest segment is deleted along with its rounds. Segments left over by a previous process are replayed too.
+	 */
+	class Spool {
+		public:
+			static constexpr std::string_view segmentExtension = ".spool"sv;			//!< Extension of segment files
+
+		protected:
+			std::string directory_;													//!< Directory holding the segment files
+			size_t segmentSize_;													//!< Size of each segment file
+			size_t maxSegmentCount_;												//!< Maximum number of segment files
+			std::deque<std::unique_ptr<SpoolSegment>> segments_;					//!< Segments, oldest first (the last one is the current segment if `hasCurrentSegment_`)
+			bool hasCurrentSegment_;												//!< Whether the last segment can be appended to
+			uint64_t nextSequence_;													//!< Sequence number of the next segment file
+			size_t droppedRoundCount_;												//!< Number of rounds lost because of disk limits or errors
+
+			/**
+			 * @brief Returns the path of a segment file
+			 */
+			std::string segmentPath(uint64_t sequence) const;
+
+			/**
+			 * @brief Starts a new current segment, deleting the oldest segments if needed
+			 *
+			 * @return *true* if the new segment was created
+			 */
+			bool startSegment();
+
+			/**
+			 * @brief Deletes the oldest segment, counting its pending rounds as dropped
+			 */
+			void dropOldestSegment() noexcept;
+
+		public:
+			/**
+			 * @brief Construct a new Spool object, loading the segments found in its directory
+			 *
+			 * @param directory directory holding the segment files, created if needed
+			 * @param segmentSize size of each segment file
+			 * @param maxSegmentCount maximum number of segment files (at least 2)
+			 */
+			Spool(const std::string& directory, size_t segmentSize, size_t maxSegmentCount);
+
+
+			/**
+			 * @brief Returns the directory holding the segment files
+			 */
+			const std::string& directory() const noexcept;
+
+			/**
+			 * @brief Returns the number of rounds waiting to be replayed
+			 */
+			size_t pendingRoundCount() const noexcept;
+
+			/**
+			 * @brief Returns the number of rounds lost because of disk limits or errors
+			 */
+			size_t droppedRoundCount() const noexcept;
+
+
+			/**
+			 * @brief Appends a round of metrics
+			 *
+			 * @param metrics the metrics of the round
+			 * @return *true* if the round was stored
+			 * @return *false* if the round was dropped
+			 */
+			bool append(const std::vector<Metric>& metrics);
+
+			/**
+			 * @brief Replays pending rounds, oldest first, in batches
+			 *
+			 * Rounds are marked as replayed once their batch is accepted, and segments are deleted once all their rounds are replayed. The current segment is closed first, so that rounds appended afterwards go to a new segment.
+			 *
+			 * @param consumer function called with each batch; returns *false* if the batch could not be published, which stops the replay
+			 * @param batchSize minimum number of metrics per batch (batches only end on round boundaries)
+			 * @return *true* if all pending rounds were replayed
+			 * @return *false* otherwise
+			 */
+			bool replay(const std::function<bool(const std::vector<Metric>&)>& consumer, size_t batchSize);
+	};
+}
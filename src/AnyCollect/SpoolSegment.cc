@@ -0,0 +1,379 @@
+//
+// SpoolSegment.cc
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SpoolSegment.h"
+
+
+namespace AnyCollect {
+	namespace {
+		// Each element takes at least one byte, which bounds counts read from corrupted data
+		size_t readCount(BitReader& reader, size_t size) noexcept {
+			size_t count = reader.readVarint();
+			if (reader.hasOverflowed() || count > size - std::min(reader.bytePosition(), size)) {
+				reader.setOverflowed();
+				return 0;
+			}
+			return count;
+		}
+	}
+
+
+	SpoolSegment::SpoolSegment(const std::string& path, int fd, uint8_t* data, size_t size, bool isWritable) noexcept :
+		path_(path),
+		fd_(fd),
+		data_(data),
+		size_(size),
+		isWritable_(isWritable)
+	{ }
+
+	std::unique_ptr<SpoolSegment> SpoolSegment::create(const std::string& path, size_t size) noexcept {
+		if (size <= sizeof(Header))
+			return nullptr;
+		int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if (fd < 0) {
+			perror(std::string(path).append(": Error creating spool segment").c_str());
+			return nullptr;
+		}
+		if (ftruncate(fd, size) != 0) {
+			perror(std::string(path).append(": Error allocating spool segment").c_str());
+			::close(fd);
+			::unlink(path.c_str());
+			return nullptr;
+		}
+		void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) {
+			perror(std::string(path).append(": Error mapping spool segment").c_str());
+			::close(fd);
+			::unlink(path.c_str());
+			return nullptr;
+		}
+
+		std::unique_ptr<SpoolSegment> segment{new SpoolSegment(path, fd, static_cast<uint8_t*>(data), size, true)};
+		segment->header() = Header{SpoolSegment::magic, 0, 0, 0};
+		return segment;
+	}
+
+	std::unique_ptr<SpoolSegment> SpoolSegment::open(const std::string& path) noexcept {
+		int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+		if (fd < 0) {
+			perror(std::string(path).append(": Error opening spool segment").c_str());
+			return nullptr;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) <= sizeof(Header)) {
+			::close(fd);
+			return nullptr;
+		}
+		size_t size = st.st_size;
+		void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) {
+			perror(std::string(path).append(": Error mapping spool segment").c_str());
+			::close(fd);
+			return nullptr;
+		}
+
+		std::unique_ptr<SpoolSegment> segment{new SpoolSegment(path, fd, static_cast<uint8_t*>(data), size, false)};
+		const Header& header = segment->header();
+		if (header.magic != SpoolSegment::magic || header.used > size - sizeof(Header) || header.replayedRoundCount > header.roundCount)
+			return nullptr;
+		return segment;
+	}
+
+	SpoolSegment::~SpoolSegment() {
+		if (this->data_ != nullptr)
+			munmap(this->data_, this->size_);
+		if (this->fd_ >= 0)
+			::close(this->fd_);
+	}
+
+
+	const std::string& SpoolSegment::path() const noexcept {
+		return this->path_;
+	}
+
+	size_t SpoolSegment::roundCount() const noexcept {
+		return this->header().roundCount;
+	}
+
+	size_t SpoolSegment::pendingRoundCount() const noexcept {
+		return this->header().roundCount - this->header().replayedRoundCount;
+	}
+
+	void SpoolSegment::setReplayedRoundCount(size_t count) noexcept {
+		this->header().replayedRoundCount = count;
+	}
+
+	void SpoolSegment::seal() noexcept {
+		this->isWritable_ = false;
+		this->seriesIds_ = {};
+		this->series_ = {};
+		this->buffer_ = {};
+	}
+
+
+	void SpoolSegment::encodeTimestamp(BitWriter& writer, SeriesState& state, int64_t timestamp) {
+		if (state.sampleCount == 0) {
+			writer.writeBits(static_cast<uint64_t>(timestamp), 64);
+		} else {
+			int64_t delta = timestamp - state.timestamp;
+			int64_t deltaOfDelta = delta - state.delta;
+			uint64_t zigzag = (static_cast<uint64_t>(deltaOfDelta) << 1) ^ static_cast<uint64_t>(deltaOfDelta >> 63);
+			if (zigzag == 0) {
+				writer.writeBit(false);
+			} else if (zigzag < (1 << 7)) {
+				writer.writeBits(0b10, 2);
+				writer.writeBits(zigzag, 7);
+			} else if (zigzag < (1 << 9)) {
+				writer.writeBits(0b110, 3);
+				writer.writeBits(zigzag, 9);
+			} else if (zigzag < (1 << 12)) {
+				writer.writeBits(0b1110, 4);
+				writer.writeBits(zigzag, 12);
+			} else {
+				writer.writeBits(0b1111, 4);
+				writer.writeBits(zigzag, 64);
+			}
+			state.delta = delta;
+		}
+		state.timestamp = timestamp;
+	}
+
+	int64_t SpoolSegment::decodeTimestamp(BitReader& reader, SeriesState& state) noexcept {
+		if (state.sampleCount == 0) {
+			state.timestamp = static_cast<int64_t>(reader.readBits(64));
+			return state.timestamp;
+		}
+
+		uint64_t zigzag = 0;
+		if (reader.readBit()) {
+			if (!reader.readBit())
+				zigzag = reader.readBits(7);
+			else if (!reader.readBit())
+				zigzag = reader.readBits(9);
+			else if (!reader.readBit())
+				zigzag = reader.readBits(12);
+			else
+				zigzag = reader.readBits(64);
+		}
+		int64_t deltaOfDelta = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+		state.delta += deltaOfDelta;
+		state.timestamp += state.delta;
+		return state.timestamp;
+	}
+
+	void SpoolSegment::encodeValue(BitWriter& writer, SeriesState& state, double value) {
+		uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		if (state.sampleCount == 0) {
+			writer.writeBits(bits, 64);
+			state.value = bits;
+			return;
+		}
+
+		uint64_t xored = bits ^ state.value;
+		state.value = bits;
+		if (xored == 0) {
+			writer.writeBit(false);
+			return;
+		}
+		writer.writeBit(true);
+
+		unsigned leading = std::min<unsigned>(__builtin_clzll(xored), 31);
+		unsigned trailing = __builtin_ctzll(xored);
+		if (state.hasWindow && leading >= state.leading && trailing >= state.trailing) {
+			// Reuse the previous window
+			writer.writeBit(false);
+			writer.writeBits(xored >> state.trailing, 64 - state.leading - state.trailing);
+		} else {
+			unsigned meaningful = 64 - leading - trailing;
+			writer.writeBit(true);
+			writer.writeBits(leading, 5);
+			writer.writeBits(meaningful - 1, 6);
+			writer.writeBits(xored >> trailing, meaningful);
+			state.leading = leading;
+			state.trailing = trailing;
+			state.hasWindow = true;
+		}
+	}
+
+	double SpoolSegment::decodeValue(BitReader& reader, SeriesState& state) noexcept {
+		if (state.sampleCount == 0) {
+			state.value = reader.readBits(64);
+		} else if (reader.readBit()) {
+			if (reader.readBit()) {
+				state.leading = static_cast<unsigned>(reader.readBits(5));
+				unsigned meaningful = static_cast<unsigned>(reader.readBits(6)) + 1;
+				state.trailing = (state.leading + meaningful <= 64) ? 64 - state.leading - meaningful : 0;
+				state.hasWindow = true;
+			}
+			state.value ^= reader.readBits(64 - state.leading - state.trailing) << state.trailing;
+		}
+
+		double value;
+		std::memcpy(&value, &state.value, sizeof(value));
+		return value;
+	}
+
+
+	bool SpoolSegment::append(const std::vector<Metric>& metrics) {
+		if (!this->isWritable_)
+			return false;
+
+		this->buffer_.clear();
+		BitWriter writer{this->buffer_};
+		uint32_t nextDefinition = static_cast<uint32_t>(this->series_.size());
+		std::vector<uint32_t> ids;
+		ids.reserve(metrics.size());
+		for (const auto& metric : metrics) {
+			auto result = this->seriesIds_.try_emplace(metric.key(), static_cast<uint32_t>(this->series_.size()));
+			ids.push_back(result.first->second);
+			if (result.second)
+				this->series_.emplace_back();
+		}
+
+		// Definitions of new series, in the order their identifiers were assigned
+		writer.writeVarint(this->series_.size() - nextDefinition);
+		auto& pool = StringPool::shared();
+		for (size_t i = 0; i < metrics.size(); i++) {
+			if (ids[i] != nextDefinition)
+				continue;
+			const auto& identity = *metrics[i].identity();
+			writer.writeVarint(identity.name.size());
+			for (auto part : identity.name)
+				writer.writeString(pool.string(part));
+			writer.writeVarint(identity.tags.size());
+			for (const auto& tag : identity.tags) {
+				writer.writeString(pool.string(tag.first));
+				writer.writeString(pool.string(tag.second));
+			}
+			writer.writeString(pool.string(identity.unit));
+			nextDefinition++;
+		}
+
+		// Columns
+		writer.writeVarint(metrics.size());
+		for (auto id : ids)
+			writer.writeVarint(id);
+		writer.align();
+		for (size_t i = 0; i < metrics.size(); i++) {
+			auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(metrics[i].timestamp().time_since_epoch()).count();
+			SpoolSegment::encodeTimestamp(writer, this->series_[ids[i]], timestamp);
+		}
+		writer.align();
+		for (size_t i = 0; i < metrics.size(); i++) {
+			SpoolSegment::encodeValue(writer, this->series_[ids[i]], metrics[i].value());
+			this->series_[ids[i]].sampleCount++;
+		}
+
+		// The encoding state now includes this record: if it does not fit, no other record can be appended
+		Header& header = this->header();
+		uint32_t recordSize = static_cast<uint32_t>(this->buffer_.size());
+		if (sizeof(Header) + header.used + sizeof(recordSize) + recordSize > this->size_) {
+			this->seal();
+			return false;
+		}
+
+		uint8_t* record = this->data_ + sizeof(Header) + header.used;
+		std::memcpy(record, &recordSize, sizeof(recordSize));
+		std::memcpy(record + sizeof(recordSize), this->buffer_.data(), recordSize);
+		header.used += sizeof(recordSize) + recordSize;
+		header.roundCount++;
+		return true;
+	}
+
+	bool SpoolSegment::forEachPendingRound(const std::function<bool(size_t, std::vector<Metric>&&)>& function) const {
+		const Header& header = this->header();
+		std::vector<std::shared_ptr<const Metric::Identity>> identities;
+		std::vector<SeriesState> states;
+		size_t offset = 0;
+		for (size_t round = 0; round < header.roundCount; round++) {
+			uint32_t recordSize;
+			if (offset + sizeof(recordSize) > header.used)
+				return false;
+			std::memcpy(&recordSize, this->data_ + sizeof(Header) + offset, sizeof(recordSize));
+			offset += sizeof(recordSize);
+			if (offset + recordSize > header.used)
+				return false;
+			BitReader reader{this->data_ + sizeof(Header) + offset, recordSize};
+			offset += recordSize;
+
+			size_t newSeriesCount = readCount(reader, recordSize);
+			for (size_t i = 0; i < newSeriesCount && !reader.hasOverflowed(); i++) {
+				std::vector<std::string> name(readCount(reader, recordSize));
+				for (auto& part : name)
+					part = reader.readString();
+				std::map<std::string, std::string> tags;
+				size_t tagCount = readCount(reader, recordSize);
+				for (size_t j = 0; j < tagCount && !reader.hasOverflowed(); j++) {
+					std::string key{reader.readString()};
+					tags.emplace(std::move(key), reader.readString());
+				}
+				std::string unit{reader.readString()};
+				// Without room in the string pool, the metrics of the series are skipped
+				auto metric = Metric::make(name, tags, unit);
+				identities.push_back(metric.has_value() ? metric.value().identity() : nullptr);
+				states.emplace_back();
+			}
+			if (reader.hasOverflowed())
+				return false;
+
+			size_t metricCount = readCount(reader, recordSize);
+			if (reader.hasOverflowed())
+				return false;
+			std::vector<uint32_t> ids(metricCount);
+			for (auto& id : ids) {
+				id = static_cast<uint32_t>(reader.readVarint());
+				if (id >= identities.size())
+					return false;
+			}
+			std::vector<int64_t> timestamps(metricCount);
+			reader.align();
+			for (size_t i = 0; i < metricCount; i++)
+				timestamps[i] = SpoolSegment::decodeTimestamp(reader, states[ids[i]]);
+			reader.align();
+			std::vector<Metric> metrics;
+			metrics.reserve(metricCount);
+			for (size_t i = 0; i < metricCount; i++) {
+				double value = SpoolSegment::decodeValue(reader, states[ids[i]]);
+				states[ids[i]].sampleCount++;
+				if (identities[ids[i]] != nullptr)
+					metrics.emplace_back(identities[ids[i]], value, std::chrono::system_clock::time_point{std::chrono::milliseconds{timestamps[i]}}, round);
+			}
+			if (reader.hasOverflowed())
+				return false;
+
+			if (round >= header.replayedRoundCount && !function(round, std::move(metrics)))
+				return false;
+		}
+		return true;
+	}
+
+	void SpoolSegment::remove() noexcept {
+		::unlink(this->path_.c_str());
+	}
+}
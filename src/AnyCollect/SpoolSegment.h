@@ -0,0 +1,190 @@
+//
+// SpoolSegment.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BitStream.h"
+#include "Hash.h"
+#include "Metric.h"
+
+
+namespace AnyCollect {
+	/**
+	 * @brief Class used to store collection rounds in a fixed-size memory-mapped file
+	 *
+	 * A segment starts with a header followed by round records. Each record is column-oriented: the definitions of the series seen for the first time in the segment, then the column of series identifiers, the column of timestamps and the column of values. Timestamps (in milliseconds) are encoded as delta-of-deltas and values as XOR with the previous value of the same series (Gorilla encoding), so that regularly sampled and slowly changing series take a few bits per sample.
+	 *
+	 * Encoding state is kept per series across records, so records can only be decoded in order from the beginning of the segment. Only segments created by the process are appended to; segments found on disk are read-only.
+	 */
+	class SpoolSegment {
+		public:
+			static constexpr uint64_t magic = 0x31304c4f4f505341;						//!< Magic number of segment files ("ASPOOL01")
+
+		protected:
+			/**
+			 * @brief Header at the beginning of a segment file
+			 */
+			struct Header {
+				uint64_t magic;															//!< Magic number (`SpoolSegment::magic`)
+				uint64_t used;															//!< Number of bytes used by records after the header
+				uint64_t roundCount;													//!< Number of records
+				uint64_t replayedRoundCount;											//!< Number of records already replayed
+			};
+
+			/**
+			 * @brief Encoding state of a series
+			 */
+			struct SeriesState {
+				uint64_t sampleCount = 0;												//!< Number of samples of the series in the segment
+				int64_t timestamp = 0;													//!< Previous timestamp (in milliseconds)
+				int64_t delta = 0;														//!< Previous difference between timestamps
+				uint64_t value = 0;														//!< Bits of the previous value
+				unsigned leading = 0;													//!< Leading zero bits of the previous meaningful XOR window
+				unsigned trailing = 0;													//!< Trailing zero bits of the previous meaningful XOR window
+				bool hasWindow = false;													//!< Whether a meaningful XOR window was written
+			};
+
+			std::string path_;															//!< Path of the segment file
+			int fd_;																	//!< File descriptor of the segment file
+			uint8_t* data_;																//!< Mapped contents of the segment file
+			size_t size_;																//!< Size of the segment file
+			bool isWritable_;															//!< Whether records can be appended
+			std::unordered_map<Key, uint32_t> seriesIds_;								//!< Map associating series keys to their identifier in the segment (writable segments only)
+			std::vector<SeriesState> series_;											//!< Encoding state of each series (writable segments only)
+			std::vector<uint8_t> buffer_;												//!< Buffer used to encode a record
+
+			/**
+			 * @brief Construct a new SpoolSegment object from an opened file
+			 */
+			SpoolSegment(const std::string& path, int fd, uint8_t* data, size_t size, bool isWritable) noexcept;
+
+			/**
+			 * @brief Returns the header of the segment
+			 */
+			Header& header() const noexcept {
+				return *reinterpret_cast<Header*>(this->data_);
+			}
+
+			/**
+			 * @brief Encodes a timestamp of a series
+			 */
+			static void encodeTimestamp(BitWriter& writer, SeriesState& state, int64_t timestamp);
+
+			/**
+			 * @brief Decodes a timestamp of a series
+			 */
+			static int64_t decodeTimestamp(BitReader& reader, SeriesState& state) noexcept;
+
+			/**
+			 * @brief Encodes a value of a series
+			 */
+			static void encodeValue(BitWriter& writer, SeriesState& state, double value);
+
+			/**
+			 * @brief Decodes a value of a series
+			 */
+			static double decodeValue(BitReader& reader, SeriesState& state) noexcept;
+
+		public:
+			/**
+			 * @brief Creates a new writable segment file
+			 *
+			 * @param path path of the file, which must not exist
+			 * @param size size of the file
+			 * @return the segment, or null if the file could not be created
+			 */
+			static std::unique_ptr<SpoolSegment> create(const std::string& path, size_t size) noexcept;
+
+			/**
+			 * @brief Opens an existing segment file, read-only
+			 *
+			 * @param path path of the file
+			 * @return the segment, or null if the file could not be opened or is not a valid segment
+			 */
+			static std::unique_ptr<SpoolSegment> open(const std::string& path) noexcept;
+
+			/**
+			 * @brief Destroy the SpoolSegment object, unmapping its file
+			 */
+			~SpoolSegment();
+
+			SpoolSegment(const SpoolSegment&) = delete;
+			SpoolSegment& operator=(const SpoolSegment&) = delete;
+
+
+			/**
+			 * @brief Returns the path of the segment file
+			 */
+			const std::string& path() const noexcept;
+
+			/**
+			 * @brief Returns the number of records in the segment
+			 */
+			size_t roundCount() const noexcept;
+
+			/**
+			 * @brief Returns the number of records not replayed yet
+			 */
+			size_t pendingRoundCount() const noexcept;
+
+			/**
+			 * @brief Marks records as replayed
+			 *
+			 * @param count number of records replayed since the beginning of the segment
+			 */
+			void setReplayedRoundCount(size_t count) noexcept;
+
+			/**
+			 * @brief Makes the segment read-only, releasing its encoding state
+			 */
+			void seal() noexcept;
+
+
+			/**
+			 * @brief Appends a record holding metrics
+			 *
+			 * @param metrics the metrics of the round
+			 * @return *true* if the record was appended
+			 * @return *false* if the segment is read-only or has not enough space left, in which case it becomes read-only
+			 */
+			bool append(const std::vector<Metric>& metrics);
+
+			/**
+			 * @brief Decodes the records not replayed yet, in order
+			 *
+			 * @param function function called with the index and the metrics of each record; returns *false* to stop decoding
+			 * @return *true* if all records were decoded
+			 * @return *false* if the function stopped decoding or the segment is corrupted
+			 */
+			bool forEachPendingRound(const std::function<bool(size_t, std::vector<Metric>&&)>& function) const;
+
+			/**
+			 * @brief Deletes the segment file (the segment object must not be used afterwards)
+			 */
+			void remove() noexcept;
+	};
+}
@@ -0,0 +1,116 @@
+//
+// StringPool.cc
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <iostream>
+
+#include "StringPool.h"
+
+
+namespace AnyCollect {
+	StringPool::StringPool() noexcept :
+		slotCount_(0),
+		size_(0),
+		isFull_(false)
+	{
+		for (auto& chunk : this->chunks_)
+			chunk.store(nullptr, std::memory_order_relaxed);
+		this->intern("");
+	}
+
+	StringPool::~StringPool() {
+		for (auto& chunk : this->chunks_)
+			delete[] chunk.load(std::memory_order_relaxed);
+	}
+
+
+	StringPool& StringPool::shared() noexcept {
+		// Never destroyed, so that series identities destroyed during static destruction can still release their strings
+		static StringPool* pool = new StringPool();
+		return *pool;
+	}
+
+
+	std::optional<StringId> StringPool::intern(std::string_view str) {
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		auto itr = this->ids_.find(str);
+		if (itr != this->ids_.end()) {
+			StringId id = itr->second;
+			Entry& entry = this->chunks_[id >> StringPool::chunkBits].load(std::memory_order_relaxed)[id & (StringPool::chunkSize - 1)];
+			entry.referenceCount++;
+			return id;
+		}
+
+		StringId id;
+		if (!this->freeIds_.empty()) {
+			id = this->freeIds_.back();
+			this->freeIds_.pop_back();
+		} else if ((this->slotCount_ >> StringPool::chunkBits) < StringPool::maxChunks) {
+			id = this->slotCount_++;
+		} else {
+			if (!this->isFull_.exchange(true, std::memory_order_relaxed))
+				std::cerr << "String pool is full, new strings cannot be interned until others are released." << std::endl;
+			return std::optional<StringId>{};
+		}
+
+		size_t chunkIndex = id >> StringPool::chunkBits;
+		Entry* chunk = this->chunks_[chunkIndex].load(std::memory_order_relaxed);
+		if (chunk == nullptr) {
+			chunk = new Entry[StringPool::chunkSize];
+			this->chunks_[chunkIndex].store(chunk, std::memory_order_release);
+		}
+
+		Entry& entry = chunk[id & (StringPool::chunkSize - 1)];
+		entry.string = std::string(str);
+		entry.key = Hasher::hash(entry.string);
+		entry.referenceCount = 1;
+		this->ids_.emplace(std::string_view{entry.string}, id);
+		this->size_.fetch_add(1, std::memory_order_release);
+		return std::make_optional(id);
+	}
+
+	void StringPool::retain(StringId id) noexcept {
+		if (id == StringPool::emptyId)
+			return;
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		this->chunks_[id >> StringPool::chunkBits].load(std::memory_order_relaxed)[id & (StringPool::chunkSize - 1)].referenceCount++;
+	}
+
+	void StringPool::release(StringId id) noexcept {
+		if (id == StringPool::emptyId)
+			return;
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		Entry& entry = this->chunks_[id >> StringPool::chunkBits].load(std::memory_order_relaxed)[id & (StringPool::chunkSize - 1)];
+		if (--entry.referenceCount > 0)
+			return;
+		this->ids_.erase(std::string_view{entry.string});
+		std::string().swap(entry.string);
+		this->freeIds_.push_back(id);
+		this->size_.fetch_sub(1, std::memory_order_release);
+		this->isFull_.store(false, std::memory_order_relaxed);
+	}
+
+	size_t StringPool::size() const noexcept {
+		return this->size_.load(std::memory_order_acquire);
+	}
+
+	bool StringPool::isFull() const noexcept {
+		return this->isFull_.load(std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,150 @@
+//
+// StringPool.h
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Hash.h"
+
+
+namespace AnyCollect {
+	using StringId = uint32_t;		//!< Identifier of an interned string
+
+	/**
+	 * @brief Process-wide pool of interned strings (metric names, tag keys, tag values and units)
+	 *
+	 * Each distinct string is stored once, along with its key, and is referred to by a `StringId`. Strings are reference counted: `intern` and `retain` acquire a reference, `release` drops it, and the slot of a string is reused once its last reference is dropped. Interned strings are never moved, so they can be read from any thread without locking as long as a reference is held.
+	 *
+	 * The pool holds at most `maxChunks * chunkSize` strings at once: `intern` fails once it is full, rather than growing without bounds.
+	 */
+	class StringPool {
+		public:
+			static constexpr StringId emptyId = 0;							//!< Identifier of the empty string, which is never freed
+
+		protected:
+			static constexpr size_t chunkBits = 12;							//!< Number of bits of a string identifier used as index in a chunk
+			static constexpr size_t chunkSize = 1 << StringPool::chunkBits;	//!< Number of strings stored in a chunk
+			static constexpr size_t maxChunks = 1 << 14;					//!< Maximum number of chunks
+
+			/**
+			 * @brief Interned string, along with its key
+			 */
+			struct Entry {
+				std::string string;											//!< The interned string
+				Key key;													//!< Key of the string, as computed by `Hasher::hash`
+				uint32_t referenceCount;									//!< Number of references to the string (protected by `mutex_`)
+			};
+
+			std::mutex mutex_;												//!< Mutex protecting interning and reference counts
+			std::unordered_map<std::string_view, StringId> ids_;			//!< Map associating interned strings to their identifier
+			std::array<std::atomic<Entry*>, StringPool::maxChunks> chunks_;	//!< Fixed-size chunks of entries, never reallocated
+			StringId slotCount_;											//!< Number of entries ever used (protected by `mutex_`)
+			std::vector<StringId> freeIds_;									//!< Entries whose string was released, reused first (protected by `mutex_`)
+			std::atomic<size_t> size_;										//!< Number of interned strings
+			std::atomic<bool> isFull_;										//!< Whether the last string could not be interned, and no string was released since
+
+			/**
+			 * @brief Returns the entry of an interned string
+			 */
+			const Entry& entry(StringId id) const noexcept {
+				return this->chunks_[id >> StringPool::chunkBits].load(std::memory_order_acquire)[id & (StringPool::chunkSize - 1)];
+			}
+
+			/**
+			 * @brief Construct a new StringPool object, containing only the empty string
+			 */
+			StringPool() noexcept;
+
+		public:
+			/**
+			 * @brief Destroy the StringPool object
+			 */
+			~StringPool();
+
+			StringPool(const StringPool&) = delete;
+			StringPool& operator=(const StringPool&) = delete;
+
+			/**
+			 * @brief Returns the process-wide string pool
+			 */
+			static StringPool& shared() noexcept;
+
+
+			/**
+			 * @brief Returns the identifier of a string, interning it if needed, and acquires a reference to it
+			 *
+			 * @param str the string to intern
+			 * @return the string's identifier, or nothing if the pool is full
+			 */
+			std::optional<StringId> intern(std::string_view str);
+
+			/**
+			 * @brief Acquires one more reference to an interned string
+			 *
+			 * @param id identifier of the string
+			 */
+			void retain(StringId id) noexcept;
+
+			/**
+			 * @brief Drops a reference to an interned string, freeing it when it was the last one
+			 *
+			 * @param id identifier of the string
+			 */
+			void release(StringId id) noexcept;
+
+			/**
+			 * @brief Returns an interned string
+			 *
+			 * @param id identifier of the string
+			 */
+			const std::string& string(StringId id) const noexcept {
+				return this->entry(id).string;
+			}
+
+			/**
+			 * @brief Returns the key of an interned string
+			 *
+			 * @param id identifier of the string
+			 */
+			const Key& key(StringId id) const noexcept {
+				return this->entry(id).key;
+			}
+
+			/**
+			 * @brief Returns the number of distinct interned strings
+			 */
+			size_t size() const noexcept;
+
+			/**
+			 * @brief Returns whether the pool was found full, i.e. a string could not be interned and no string was freed since
+			 */
+			bool isFull() const noexcept;
+	};
+}
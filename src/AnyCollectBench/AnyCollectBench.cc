@@ -0,0 +1,307 @@
+//
+// AnyCollectBench.cc
+//
+// Created on October 19th 2026
+//
+// Copyright 2018 CFM (www.cfm.fr)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+#include <json.hpp>
+
+#include <AnyCollect/Controller.h>
+
+namespace fs = boost::filesystem;
+
+
+#ifndef ANYCOLLECT_BENCH_FIXTURES
+#define ANYCOLLECT_BENCH_FIXTURES "fixtures"
+#endif
+
+#ifndef ANYCOLLECT_BENCH_EXAMPLES
+#define ANYCOLLECT_BENCH_EXAMPLES "example"
+#endif
+
+
+// Recorded /proc files and the example configs reading them, with the same index
+static const std::vector<std::pair<std::string, std::string>> procFixtures = {
+	{"proc/stat", "procstat.json"},
+	{"proc/meminfo", "procmeminfo.json"},
+	{"proc/net/dev", "procnetdev.json"},
+};
+
+static std::string fixturesDirectory = ANYCOLLECT_BENCH_FIXTURES;
+static std::string examplesDirectory = ANYCOLLECT_BENCH_EXAMPLES;
+static fs::path workDirectory;
+
+
+std::string readFile(const std::string& path) {
+	std::ifstream file(path);
+	if (!file) {
+		std::cerr << path << ": Error opening benchmark file" << std::endl;
+		std::exit(1);
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+	return contents.str();
+}
+
+void writeFile(const std::string& path, const std::string& contents) {
+	std::ofstream file(path);
+	file << contents;
+}
+
+// Example config reading the recorded fixtures instead of the live /proc files
+std::string fixtureConfig(size_t fixture) {
+	std::string config = readFile(examplesDirectory + "/" + procFixtures[fixture].second);
+	std::string from = "\"/proc/";
+	std::string to = "\"" + fixturesDirectory + "/proc/";
+	for (size_t position = config.find(from); position != std::string::npos; position = config.find(from, position + to.size()))
+		config.replace(position, from.size(), to);
+	return config;
+}
+
+// Synthetic file of `lineCount` lines, each holding a distinct series of `group` g (g < groupCount)
+std::string syntheticFile(size_t lineCount, size_t groupCount = 1) {
+	std::string path = (workDirectory / ("synthetic_" + std::to_string(lineCount) + "_" + std::to_string(groupCount))).string();
+	if (!fs::exists(path)) {
+		std::string contents;
+		for (size_t i = 0; i < lineCount; i++)
+			contents += "group" + std::to_string(i % groupCount) + " series" + std::to_string(i) + " " + std::to_string(i * 7919 % 1000003) + "\n";
+		writeFile(path, contents);
+	}
+	return path;
+}
+
+// Config with `expressionCount` expressions on a synthetic file, each matching the lines of one group
+std::string syntheticConfig(const std::string& path, size_t expressionCount) {
+	nlohmann::json expressions = nlohmann::json::array();
+	for (size_t i = 0; i < expressionCount; i++) {
+		nlohmann::json metric = {{"Name", {"synthetic", "$1"}}, {"Value", "$2"}, {"Unit", ""}, {"Tags", {{"group", std::to_string(i)}}}, {"ComputeRate", true}, {"ConvertToUnitsPerSecond", true}};
+		expressions.push_back({{"Regex", "^group" + std::to_string(i) + " (\\w+) (\\d+)$"}, {"Metrics", {metric}}});
+	}
+	nlohmann::json file = {{"Paths", {path}}, {"Expressions", expressions}};
+	return nlohmann::json{{"Files", {file}}, {"Commands", nlohmann::json::array()}}.dump();
+}
+
+std::string writeConfig(const std::string& name, const std::string& contents) {
+	std::string path = (workDirectory / name).string();
+	writeFile(path, contents);
+	return path;
+}
+
+
+struct BenchDelegate : public AnyCollect::ControllerDelegate {
+	void contollerCollectedMetrics(const AnyCollect::Controller& , const std::vector<const AnyCollect::Metric*>& ) override { }
+	bool contollerShouldStopCollectingMetrics(const AnyCollect::Controller& ) override { return true; }
+};
+
+// Controller loaded with a config, primed so that rates are computed from the first measured round
+struct BenchController {
+	BenchDelegate delegate;
+	AnyCollect::Controller controller{delegate};
+
+	BenchController(const std::string& configPath) {
+		this->controller.setSamplingInterval(0s);
+		this->controller.loadConfigFromFile(configPath);
+		this->controller.collectOnce();
+	}
+};
+
+
+static void BM_SourceUpdate(benchmark::State& state) {
+	AnyCollect::Source source{fixturesDirectory + "/" + procFixtures[state.range(0)].first};
+	for (auto _ : state) {
+		source.update();
+		benchmark::DoNotOptimize(source.contents().data());
+	}
+	state.SetLabel(procFixtures[state.range(0)].first);
+	state.SetBytesProcessed(state.iterations() * source.contents().size());
+}
+BENCHMARK(BM_SourceUpdate)->DenseRange(0, procFixtures.size() - 1);
+
+static void BM_SourceUpdateSynthetic(benchmark::State& state) {
+	AnyCollect::Source source{syntheticFile(state.range(0))};
+	for (auto _ : state) {
+		source.update();
+		benchmark::DoNotOptimize(source.contents().data());
+	}
+	state.SetBytesProcessed(state.iterations() * source.contents().size());
+}
+BENCHMARK(BM_SourceUpdateSynthetic)->RangeMultiplier(8)->Range(1 << 6, 1 << 18);
+
+static void BM_SourceGetLine(benchmark::State& state) {
+	AnyCollect::Source source{syntheticFile(state.range(0))};
+	source.update();
+	for (auto _ : state) {
+		size_t lineCount = 0;
+		for (auto begin = source.begin(); begin < source.end(); begin = source.getLine(begin) + 1)
+			lineCount++;
+		benchmark::DoNotOptimize(lineCount);
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetBytesProcessed(state.iterations() * source.contents().size());
+}
+BENCHMARK(BM_SourceGetLine)->RangeMultiplier(8)->Range(1 << 6, 1 << 18);
+
+
+// Applies the first expression of a fixture's example config to every line of the fixture
+static void BM_ExpressionApply(benchmark::State& state) {
+	AnyCollect::Config config;
+	config.parse(fixtureConfig(state.range(0)));
+	AnyCollect::Expression expression{config.files.front().expressions.front().regex};
+	AnyCollect::Source source{config.files.front().paths.front()};
+	source.update();
+
+	size_t lineCount = 0;
+	for (auto _ : state) {
+		for (auto begin = source.begin(); begin < source.end(); begin = source.getLine(begin) + 1) {
+			benchmark::DoNotOptimize(expression.apply(begin, source.getLine(begin)).size());
+			lineCount++;
+		}
+	}
+	state.SetLabel(procFixtures[state.range(0)].first);
+	state.SetItemsProcessed(lineCount);
+}
+BENCHMARK(BM_ExpressionApply)->DenseRange(0, procFixtures.size() - 1);
+
+
+// Match of the first line of /proc/net/dev matched by its example config, for matcher benchmarks
+struct MatcherFixture {
+	AnyCollect::Config config;
+	std::unique_ptr<AnyCollect::Source> source;
+	std::unique_ptr<AnyCollect::Expression> expression;
+	std::unique_ptr<AnyCollect::Matcher> matcher;
+	const std::cmatch* match = nullptr;
+
+	MatcherFixture() {
+		this->config.parse(fixtureConfig(2));
+		const auto& expressionConfig = this->config.files.front().expressions.front();
+		this->source = std::make_unique<AnyCollect::Source>(this->config.files.front().paths.front());
+		this->expression = std::make_unique<AnyCollect::Expression>(expressionConfig.regex);
+		this->matcher = std::make_unique<AnyCollect::Matcher>(expressionConfig.metrics.front());
+		this->source->update();
+		for (auto begin = this->source->begin(); begin < this->source->end() && this->match == nullptr; begin = this->source->getLine(begin) + 1) {
+			const auto& match = this->expression->apply(begin, this->source->getLine(begin));
+			if (!match.empty())
+				this->match = &match;
+		}
+		if (this->match == nullptr) {
+			std::cerr << "No line of the /proc/net/dev fixture matches its example config" << std::endl;
+			std::exit(1);
+		}
+	}
+};
+
+static void BM_MatcherGetValue(benchmark::State& state) {
+	MatcherFixture fixture;
+	for (auto _ : state)
+		benchmark::DoNotOptimize(fixture.matcher->getValue(*fixture.match, fixture.source->pathParts()));
+}
+BENCHMARK(BM_MatcherGetValue);
+
+static void BM_MatcherGetKey(benchmark::State& state) {
+	MatcherFixture fixture;
+	for (auto _ : state)
+		benchmark::DoNotOptimize(fixture.matcher->getKey(*fixture.match, fixture.source->pathParts()));
+}
+BENCHMARK(BM_MatcherGetKey);
+
+static void BM_MatcherGetMetric(benchmark::State& state) {
+	MatcherFixture fixture;
+	for (auto _ : state)
+		benchmark::DoNotOptimize(fixture.matcher->getMetric(*fixture.match, fixture.source->pathParts()));
+}
+BENCHMARK(BM_MatcherGetMetric);
+
+
+static void BM_MetricGenerateKey(benchmark::State& state) {
+	std::vector<std::string> name(state.range(0));
+	std::map<std::string, std::string> tags;
+	for (size_t i = 0; i < name.size(); i++) {
+		name[i] = "part" + std::to_string(i);
+		tags.emplace("tag" + std::to_string(i), "value" + std::to_string(i));
+	}
+	for (auto _ : state)
+		benchmark::DoNotOptimize(AnyCollect::Metric::generateKey(name, tags));
+}
+BENCHMARK(BM_MetricGenerateKey)->DenseRange(1, 7, 2);
+
+
+// Full round on the recorded fixtures with all their example configs; each thread has its own controller
+static void BM_ControllerRound(benchmark::State& state) {
+	nlohmann::json config = {{"Files", nlohmann::json::array()}, {"Commands", nlohmann::json::array()}};
+	for (size_t i = 0; i < procFixtures.size(); i++) {
+		nlohmann::json fixture = nlohmann::json::parse(fixtureConfig(i));
+		for (const auto& file : fixture["Files"])
+			config["Files"].push_back(file);
+	}
+
+	BenchController bench{writeConfig("fixtures_" + std::to_string(state.thread_index()) + ".json", config.dump())};
+	size_t metricCount = 0;
+	for (auto _ : state)
+		metricCount += bench.controller.collectOnce().size();
+	state.SetItemsProcessed(metricCount);
+}
+BENCHMARK(BM_ControllerRound)->ThreadRange(1, 8)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// Round on a synthetic file of one expression, sweeping the number of series
+static void BM_ControllerRoundSeries(benchmark::State& state) {
+	std::string path = syntheticFile(state.range(0));
+	BenchController bench{writeConfig("series_" + std::to_string(state.range(0)) + ".json", syntheticConfig(path, 1))};
+	for (auto _ : state)
+		benchmark::DoNotOptimize(bench.controller.collectOnce().size());
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ControllerRoundSeries)->RangeMultiplier(8)->Range(1 << 6, 1 << 18)->Unit(benchmark::kMicrosecond);
+
+// Round on a synthetic file of 4096 series, sweeping the number of expressions applied on each line
+static void BM_ControllerRoundExpressions(benchmark::State& state) {
+	std::string path = syntheticFile(4096, state.range(0));
+	BenchController bench{writeConfig("expressions_" + std::to_string(state.range(0)) + ".json", syntheticConfig(path, state.range(0)))};
+	for (auto _ : state)
+		benchmark::DoNotOptimize(bench.controller.collectOnce().size());
+	state.SetItemsProcessed(state.iterations() * 4096 * state.range(0));
+}
+BENCHMARK(BM_ControllerRoundExpressions)->RangeMultiplier(4)->Range(1, 256)->Unit(benchmark::kMicrosecond);
+
+
+int main(int argc, char* argv[]) {
+	if (const char* directory = std::getenv("ANYCOLLECT_BENCH_FIXTURES"))
+		fixturesDirectory = directory;
+	if (const char* directory = std::getenv("ANYCOLLECT_BENCH_EXAMPLES"))
+		examplesDirectory = directory;
+	workDirectory = fs::temp_directory_path() / fs::unique_path("AnyCollectBench-%%%%-%%%%");
+	fs::create_directories(workDirectory);
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+
+	boost::system::error_code error;
+	fs::remove_all(workDirectory, error);
+	return 0;
+}
@@ -19,16 +19,20 @@
 //
 
 #include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
 
 #include "SnapInterface.h"
 
 
 namespace AnyCollect {
-	std::hash<std::string> SnapInterface::hasher{};
-
 	SnapInterface::SnapInterface() :
 		controller_(*this),
-		sendAllMetrics_(false)
+		samplingInterval_(Controller::defaultSamplingInterval),
+		sendAllMetrics_(false),
+		maxMetricsBuffer_(SnapInterface::defaultMaxMetricsBuffer),
+		maxMetricsBufferDelay_(Controller::defaultSamplingInterval)
 	{ }
 
 
@@ -39,70 +43,160 @@ namespace AnyCollect {
 	}
 
 	void SnapInterface::setConfig(const Plugin::Config& cfg) {
-		std::chrono::seconds sampling = Controller::defaultSamplingInterval;
+		std::chrono::milliseconds sampling = Controller::defaultSamplingInterval;
 		std::string configPath;
 		bool sendAll = SnapInterface::defaultSendAllMetrics;
+		bool selfMetrics = SnapInterface::defaultSelfMetrics;
+		size_t staleThreshold = Controller::defaultStaleSeriesThreshold;
+		std::chrono::milliseconds maxCollectDuration = SnapInterface::defaultMaxCollectDuration;
+		size_t maxMetricsBuffer = SnapInterface::defaultMaxMetricsBuffer;
+		std::chrono::milliseconds maxMetricsBufferDelay = SnapInterface::defaultMaxMetricsBufferDelay;
+		size_t maxSeries = Controller::defaultMaxSeries;
+		size_t dispatchQueueSize = SnapInterface::defaultDispatchQueueSize;
+		std::string dispatchOverflowPolicy{SnapInterface::defaultDispatchOverflowPolicy};
+		std::string configCachePath;
+		std::string counterCheckpointPath;
 
 		if (cfg.has_int_key(std::string(SnapInterface::configKeySamplingInterval)))
 			sampling = std::chrono::seconds(cfg.get_int(std::string(SnapInterface::configKeySamplingInterval)));
+		if (cfg.has_int_key(std::string(SnapInterface::configKeySamplingIntervalMs)) && cfg.get_int(std::string(SnapInterface::configKeySamplingIntervalMs)) > 0)
+			sampling = std::chrono::milliseconds(cfg.get_int(std::string(SnapInterface::configKeySamplingIntervalMs)));
 		if (cfg.has_string_key(std::string(SnapInterface::configKeyConfigFile)))
 			configPath = cfg.get_string(std::string(SnapInterface::configKeyConfigFile));
 		if (cfg.has_bool_key(std::string(SnapInterface::configKeySendAllMetrics)))
 			sendAll = cfg.get_bool(std::string(SnapInterface::configKeySendAllMetrics));
-
-		this->controller_.setSamplingInterval(sampling);
-		this->controller_.loadConfigFromFile(configPath);
+		if (cfg.has_bool_key(std::string(SnapInterface::configKeySelfMetrics)))
+			selfMetrics = cfg.get_bool(std::string(SnapInterface::configKeySelfMetrics));
+		if (cfg.has_int_key(std::string(SnapInterface::configKeyStaleSeriesThreshold)))
+			staleThreshold = std::max(cfg.get_int(std::string(SnapInterface::configKeyStaleSeriesThreshold)), 0);
+		if (cfg.has_int_key(std::string(SnapInterface::configKeyMaxCollectDuration)))
+			maxCollectDuration = std::chrono::seconds(std::max(cfg.get_int(std::string(SnapInterface::configKeyMaxCollectDuration)), 0));
+		if (cfg.has_int_key(std::string(SnapInterface::configKeyMaxMetricsBuffer)))
+			maxMetricsBuffer = std::max(cfg.get_int(std::string(SnapInterface::configKeyMaxMetricsBuffer)), 0);
+		if (cfg.has_int_key(std::string(SnapInterface::configKeyMaxMetricsBufferDelayMs)))
+			maxMetricsBufferDelay = std::chrono::milliseconds(std::max(cfg.get_int(std::string(SnapInterface::configKeyMaxMetricsBufferDelayMs)), 0));
+		if (cfg.has_int_key(std::string(SnapInterface::configKeyMaxSeries)))
+			maxSeries = std::max(cfg.get_int(std::string(SnapInterface::configKeyMaxSeries)), 0);
+		if (cfg.has_int_key(std::string(SnapInterface::configKeyDispatchQueueSize)))
+			dispatchQueueSize = std::max(cfg.get_int(std::string(SnapInterface::configKeyDispatchQueueSize)), 0);
+		if (cfg.has_string_key(std::string(SnapInterface::configKeyDispatchOverflowPolicy)))
+			dispatchOverflowPolicy = cfg.get_string(std::string(SnapInterface::configKeyDispatchOverflowPolicy));
+		if (cfg.has_string_key(std::string(SnapInterface::configKeyConfigCacheFile)))
+			configCachePath = cfg.get_string(std::string(SnapInterface::configKeyConfigCacheFile));
+		if (cfg.has_string_key(std::string(SnapInterface::configKeyCounterCheckpointFile)))
+			counterCheckpointPath = cfg.get_string(std::string(SnapInterface::configKeyCounterCheckpointFile));
+
+		auto overflowPolicy = Dispatcher::OverflowBlock;
+		if (dispatchOverflowPolicy == Dispatcher::overflowDropOldestString)
+			overflowPolicy = Dispatcher::OverflowDropOldest;
+		else if (dispatchOverflowPolicy == Dispatcher::overflowCoalesceString)
+			overflowPolicy = Dispatcher::OverflowCoalesce;
+		else if (dispatchOverflowPolicy != Dispatcher::overflowBlockString)
+			std::cerr << "Unknown dispatch overflow policy " << dispatchOverflowPolicy << ", using " << Dispatcher::overflowBlockString << "." << std::endl;
+
+		this->configureController_ = [=](Controller& controller) {
+			controller.setSamplingInterval(sampling);
+			controller.setStaleSeriesThreshold(staleThreshold);
+			controller.setMaxCollectDuration(maxCollectDuration);
+			controller.setMaxSeries(maxSeries);
+			controller.setDispatchQueue(dispatchQueueSize, overflowPolicy);
+			controller.setConfigCachePath(configCachePath);
+			controller.setCounterCheckpointPath(counterCheckpointPath);
+			controller.setEmitsSelfMetrics(selfMetrics);
+		};
+
+		// Snap configures the plugin on every call: the config is only loaded again, and metrics discovered again, when it changed
+		auto configHash = SnapInterface::hashConfigFile(configPath);
+		if (configPath != this->configPath_ || !configHash.has_value() || configHash != this->configHash_ || maxSeries != this->controller_.maxSeries()) {
+			this->controller_.setMaxSeries(maxSeries);
+			this->controller_.setConfigCachePath(configCachePath);
+			this->controller_.loadConfigFromFile(configPath);
+			this->configHash_ = configHash;
+			this->availableMetrics_.reset();
+		}
+		this->configPath_ = configPath;
+		this->samplingInterval_ = sampling;
 		this->sendAllMetrics_ = sendAll;
+		this->maxMetricsBuffer_ = maxMetricsBuffer;
+		this->maxMetricsBufferDelay_ = (maxMetricsBufferDelay.count() > 0) ? maxMetricsBufferDelay : sampling;
+	}
+
+	std::optional<Key> SnapInterface::hashConfigFile(const std::string& configPath) {
+		std::ifstream file(configPath);
+		if (!file)
+			return {};
+		std::string contents{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+		return Hasher::hash(contents);
+	}
+
+	const std::vector<Metric>& SnapInterface::availableMetrics() {
+		if (!this->availableMetrics_.has_value()) {
+			auto& availableMetrics = this->availableMetrics_.emplace();
+			for (const auto& metric : this->controller_.availableMetrics())
+				availableMetrics.push_back(*metric);
+		}
+		return this->availableMetrics_.value();
+	}
+
+	void SnapInterface::formatNamePart(std::string& part) {
+		bool wasCapitalized = false;
+		for (size_t i = 0; i < part.size(); i++) {
+			if (!std::isalnum(part[i]) && part[i] != '_') {
+				if (i > 0 && part[i - 1] != '_') {
+					part[i] = '_';
+				} else {
+					part.erase(i, 1);
+					i--;
+				}
+			}
+			else if (std::isupper(part[i])) {
+				if (i > 0 && part[i - 1] != '_' && std::islower(part[i - 1]) && !wasCapitalized) {
+					part.insert(i, "_");
+					i++;
+				}
+				part[i] = std::tolower(part[i]);
+				wasCapitalized = true;
+			} else
+				wasCapitalized = false;
+		}
+		while (part.back() == '_')
+			part.erase(part.size() - 1, 1);
+		while (part.front() == '_')
+			part.erase(0, 1);
 	}
 
 	void SnapInterface::formatName(std::vector<std::string>& name) {
 		for (auto& part : name) {
-			bool wasCapitalized = false;
-			for (size_t i = 0; i < part.size(); i++) {
-				if (!std::isalnum(part[i]) && part[i] != '_') {
-					if (i > 0 && part[i - 1] != '_') {
-						part[i] = '_';
-					} else {
-						part.erase(i, 1);
-						i--;
-					}
-				}
-				else if (std::isupper(part[i])) {
-					if (i > 0 && part[i - 1] != '_' && std::islower(part[i - 1]) && !wasCapitalized) {
-						part.insert(i, "_");
-						i++;
-					}
-					part[i] = std::tolower(part[i]);
-					wasCapitalized = true;
-				} else
-					wasCapitalized = false;
+			auto itr = this->formattedNameParts_.find(part);
+			if (itr == this->formattedNameParts_.end()) {
+				// Substituted parts may take many values over time, keep the cache bounded
+				if (this->formattedNameParts_.size() >= SnapInterface::maxFormattedNamePartCount)
+					this->formattedNameParts_.clear();
+				std::string formattedPart = part;
+				SnapInterface::formatNamePart(formattedPart);
+				itr = this->formattedNameParts_.emplace(part, std::move(formattedPart)).first;
 			}
-			while (part.back() == '_')
-				part.erase(part.size() - 1, 1);
-			while (part.front() == '_')
-				part.erase(0, 1);
+			part = itr->second;
 		}
 	}
 
-	size_t SnapInterface::computeNameKey(const Metric& m) {
-		std::string nameHash;
-		std::vector<std::string> name = m.name();
-		this->formatName(name);
+	Key SnapInterface::computeNameKey(const std::vector<std::string>& name) {
+		Hasher hasher;
+		hasher.append(static_cast<uint64_t>(name.size()));
 		for (const auto& n : name)
-			nameHash.append(n);
-		return SnapInterface::hasher(nameHash);
+			hasher.append(Hasher::hash(n));
+		return hasher.finish();
 	}
 
-	size_t SnapInterface::computeNameKey(const Plugin::Metric& m) {
-		std::string nameHash;
-		for (size_t i = 2; i < m.ns().size(); i++)
-			nameHash.append(m.ns()[i].get_value());
-		return SnapInterface::hasher(nameHash);
+	Key SnapInterface::computeNameKey(const Plugin::Metric& m) {
+		Hasher hasher;
+		hasher.append(static_cast<uint64_t>(m.ns().size() - SnapInterface::appPrefix.size()));
+		for (size_t i = SnapInterface::appPrefix.size(); i < m.ns().size(); i++)
+			hasher.append(Hasher::hash(m.ns()[i].get_value()));
+		return hasher.finish();
 	}
 
-	Plugin::Metric SnapInterface::convertToSnapMetric(const Metric& metric) {
-		std::vector<std::string> name = metric.name();
-		this->formatName(name);
+	Plugin::Metric SnapInterface::convertToSnapMetric(const Metric& metric, std::vector<std::string> name) {
 		this->insertAppPrefixToNamespace(name);
 		Plugin::Namespace ns{name};
 		Plugin::Metric snapMetric{ns, metric.unit(), ""};
@@ -113,6 +207,63 @@ namespace AnyCollect {
 		return snapMetric;
 	}
 
+	Plugin::Metric* SnapInterface::findSnapMetric(const Metric& metric) {
+		auto itr = this->metrics_.find(metric.key());
+		if (itr != this->metrics_.end())
+			return &itr->second;
+		if (this->unwantedMetrics_.count(metric.key()) > 0)
+			return nullptr;
+
+		// New series: its name is formatted once, both to check whether it is requested and to build its Snap metric
+		std::vector<std::string> name = metric.name();
+		this->formatName(name);
+		if (!this->sendAllMetrics_ && this->requestedMetrics_.count(this->computeNameKey(name)) == 0) {
+			this->unwantedMetrics_.insert(metric.key());
+			return nullptr;
+		}
+		return &this->metrics_.try_emplace(metric.key(), this->convertToSnapMetric(metric, std::move(name))).first->second;
+	}
+
+	bool SnapInterface::canProduceRequestedMetric(const Matcher& matcher, const std::vector<std::vector<std::string>>& requestedNames) {
+		const auto& pattern = matcher.name();
+		std::vector<std::string> name = pattern;
+		for (auto& part : name)
+			SnapInterface::formatNamePart(part);
+		for (const auto& requestedName : requestedNames) {
+			if (requestedName.size() != name.size())
+				continue;
+			bool matches = true;
+			for (size_t i = 0; i < name.size() && matches; i++) {
+				bool isConstant = (pattern[i].find(Matcher::matchSubstitutionPrefix) == std::string::npos && pattern[i].find(Matcher::matchEscapeChar) == std::string::npos);
+				matches = !isConstant || requestedName[i] == "*" || requestedName[i] == name[i];
+			}
+			if (matches)
+				return true;
+		}
+		return false;
+	}
+
+	void SnapInterface::sendBufferedMetrics(bool sendAll) {
+		if (this->bufferedMetrics_.empty())
+			return;
+		// Send everything now if the next round would arrive after the maximum delay (rounds are only about one interval apart, hence the half interval margin)
+		sendAll |= (std::chrono::steady_clock::now() - this->bufferStartTime_ + this->samplingInterval_ / 2 > this->maxMetricsBufferDelay_);
+
+		size_t batchSize = (this->maxMetricsBuffer_ > 0) ? this->maxMetricsBuffer_ : this->bufferedMetrics_.size();
+		size_t begin = 0;
+		while (begin < this->bufferedMetrics_.size()) {
+			size_t end = std::min(begin + batchSize, this->bufferedMetrics_.size());
+			if (end - begin < batchSize && !sendAll)
+				break;
+			this->metricsToSend_.clear();
+			for (size_t i = begin; i < end; i++)
+				this->metricsToSend_.push_back(&this->bufferedMetrics_[i]);
+			this->send_metrics(this->metricsToSend_);
+			begin = end;
+		}
+		this->bufferedMetrics_.erase(this->bufferedMetrics_.begin(), this->bufferedMetrics_.begin() + begin);
+	}
+
 
 	const Plugin::ConfigPolicy SnapInterface::get_config_policy() {
 		Plugin::ConfigPolicy policy;
@@ -124,6 +275,18 @@ namespace AnyCollect {
 		ns.emplace_back(SnapInterface::configKeyConfigFile);
 		policy.add_rule(ns, Plugin::StringRule{std::string(SnapInterface::configKeyConfigFile), {true}});
 
+		ns = baseNamespace;
+		ns.emplace_back(SnapInterface::configKeyConfigCacheFile);
+		policy.add_rule(ns, Plugin::StringRule{std::string(SnapInterface::configKeyConfigCacheFile), {std::string(), false}});
+
+		ns = baseNamespace;
+		ns.emplace_back(SnapInterface::configKeyCounterCheckpointFile);
+		policy.add_rule(ns, Plugin::StringRule{std::string(SnapInterface::configKeyCounterCheckpointFile), {std::string(), false}});
+
+		ns = baseNamespace;
+		ns.emplace_back(SnapInterface::configKeyDispatchOverflowPolicy);
+		policy.add_rule(ns, Plugin::StringRule{std::string(SnapInterface::configKeyDispatchOverflowPolicy), {std::string(SnapInterface::defaultDispatchOverflowPolicy), false}});
+
 		for (size_t i = 0; i < SnapInterface::configKeysInt.size(); i++) {
 			ns = baseNamespace;
 			ns.emplace_back(SnapInterface::configKeysInt[i]);
@@ -141,9 +304,11 @@ namespace AnyCollect {
 		std::vector<Plugin::Metric> metrics;
 		this->setConfig(cfg);
 
-		auto availableMetrics = this->controller_.availableMetrics();
-		for (auto& m : availableMetrics)
-			metrics.push_back(this->convertToSnapMetric(*m));
+		for (const auto& m : this->availableMetrics()) {
+			std::vector<std::string> name = m.name();
+			this->formatName(name);
+			metrics.push_back(this->convertToSnapMetric(m, std::move(name)));
+		}
 
 		std::vector<std::string> name = {std::string(SnapInterface::configKeySendAllMetrics)};
 		this->insertAppPrefixToNamespace(name);
@@ -160,22 +325,22 @@ namespace AnyCollect {
 		this->setConfig(metsIn.front().get_config());
 
 		this->requestedMetrics_.clear();
+		this->requestedNames_.clear();
 		for (const auto& m : metsIn) {
 			if (m.ns().size() == (SnapInterface::appPrefix.size() + 1) && m.ns()[2].get_value() == SnapInterface::configKeySendAllMetrics)
 				this->sendAllMetrics_ = true;
-			else
+			else {
 				this->requestedMetrics_.insert(this->computeNameKey(m));
+				auto& name = this->requestedNames_.emplace_back();
+				for (size_t i = SnapInterface::appPrefix.size(); i < m.ns().size(); i++)
+					name.push_back(m.ns()[i].get_value());
+			}
 		}
 
-		auto availableMetrics = this->controller_.availableMetrics();
 		this->metrics_.clear();
 		this->unwantedMetrics_.clear();
-		for (const auto& m : availableMetrics) {
-			if (this->sendAllMetrics_ || this->requestedMetrics_.count(this->computeNameKey(*m)) > 0)
-				this->metrics_.insert_or_assign(m->key(), this->convertToSnapMetric(*m));
-			else
-				this->unwantedMetrics_.insert(m->key());
-		}
+		for (const auto& m : this->availableMetrics())
+			this->findSnapMetric(m);
 	}
 
 
@@ -183,39 +348,54 @@ namespace AnyCollect {
 		if (!this->sendAllMetrics_ && this->requestedMetrics_.empty())
 			return;
 
-		this->controller_.collectMetrics();
+		// Plugin instances of the process streaming the same config share the collection, the first one setting the base sampling interval
+		auto sharedController = SharedController::forConfig(this->configPath_);
+		sharedController->configure(this->configureController_);
+
+		// Only the matchers which may produce requested metrics are evaluated while streaming. The filter is applied on the collecting thread, so it gets its own copy of the requested names
+		std::function<bool(const Matcher&)> matcherFilter;
+		if (!this->sendAllMetrics_)
+			matcherFilter = [requestedNames = this->requestedNames_](const Matcher& matcher) {
+				return SnapInterface::canProduceRequestedMetric(matcher, requestedNames);
+			};
+		sharedController->run(*this, this->samplingInterval_, std::move(matcherFilter));
+		this->sendBufferedMetrics(true);
 	}
 
 
 	void SnapInterface::contollerCollectedMetrics(const AnyCollect::Controller& , const std::vector<const AnyCollect::Metric*>& metrics) {
 		this->metricsToSend_.clear();
 		for (const auto& metric : metrics) {
-			auto itr = this->metrics_.find(metric->key());
-			if (itr != this->metrics_.end()) {
-				itr->second.set_data(metric->value());
-				itr->second.set_timestamp(metric->timestamp());
-				this->metricsToSend_.push_back(&itr->second);
-			} else if (this->sendAllMetrics_) {
-				auto itr3 = this->metrics_.insert_or_assign(metric->key(), this->convertToSnapMetric(*metric));
-				this->metricsToSend_.push_back(&itr3.first->second);
-			} else {
-				auto itr2 = this->unwantedMetrics_.find(metric->key());
-				if (itr2 == this->unwantedMetrics_.end()) {
-					if (this->requestedMetrics_.count(this->computeNameKey(*metric)) > 0) {
-						auto itr3 = this->metrics_.insert_or_assign(metric->key(), this->convertToSnapMetric(*metric));
-						this->metricsToSend_.push_back(&itr3.first->second);
-					} else {
-						this->unwantedMetrics_.insert(metric->key());
-					}
-				}
-			}
+			auto snapMetric = this->findSnapMetric(*metric);
+			if (snapMetric == nullptr)
+				continue;
+			snapMetric->set_data(metric->value());
+			snapMetric->set_timestamp(metric->timestamp());
+			this->metricsToSend_.push_back(snapMetric);
 		}
-		this->send_metrics(this->metricsToSend_);
+		if (this->maxMetricsBuffer_ == 0) {
+			this->send_metrics(this->metricsToSend_);
+			return;
+		}
+
+		// Snap metrics are updated in place each round, buffer copies of them
+		if (this->bufferedMetrics_.empty())
+			this->bufferStartTime_ = std::chrono::steady_clock::now();
+		for (const auto& snapMetric : this->metricsToSend_)
+			this->bufferedMetrics_.push_back(*snapMetric);
+		this->sendBufferedMetrics(false);
 	}
 
 	bool SnapInterface::contollerShouldStopCollectingMetrics(const AnyCollect::Controller& ) {
 		return this->context_cancelled();
 	}
+
+	void SnapInterface::contollerEvictedMetrics(const AnyCollect::Controller& , const std::vector<Key>& keys) {
+		for (const auto& key : keys) {
+			this->metrics_.erase(key);
+			this->unwantedMetrics_.erase(key);
+		}
+	}
 }
 
 
@@ -22,11 +22,16 @@
 
 #include <array>
 #include <chrono>
+#include <functional>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <AnyCollect/Controller.h>
+#include <AnyCollect/SharedController.h>
 #include <snap/plugin.h>
 
 using namespace std::literals;
@@ -42,24 +47,48 @@ namespace AnyCollect {
 			static constexpr std::array appPrefix = {"cfm"sv, "anycollect"sv};								//!< Snap metric name prefix
 			static constexpr std::string_view configKeyConfigFile = "ConfigFile"sv;							//!< Snap plugin configuration key
 			static constexpr std::string_view configKeySamplingInterval = "SamplingInterval"sv;				//!< Snap plugin configuration key
+			static constexpr std::string_view configKeySamplingIntervalMs = "SamplingIntervalMs"sv;			//!< Snap plugin configuration key
 			static constexpr std::string_view configKeySendAllMetrics = "SendAllMetrics"sv;					//!< Snap plugin configuration key
+			static constexpr std::string_view configKeySelfMetrics = "SelfMetrics"sv;						//!< Snap plugin configuration key
 			static constexpr std::string_view configKeyMaxCollectDuration = "MaxCollectDuration"sv;			//!< Snap plugin configuration key
 			static constexpr std::string_view configKeyMaxMetricsBuffer = "MaxMetricsBuffer"sv;				//!< Snap plugin configuration key
-			static constexpr std::array configKeysInt = {configKeySamplingInterval, configKeyMaxCollectDuration, configKeyMaxMetricsBuffer};		//!< Array of integer-valued configuration keys
-			static constexpr std::array configKeysBool = {configKeySendAllMetrics};							//!< Array of boolean-valued configuration keys
+			static constexpr std::string_view configKeyMaxMetricsBufferDelayMs = "MaxMetricsBufferDelayMs"sv;	//!< Snap plugin configuration key
+			static constexpr std::string_view configKeyStaleSeriesThreshold = "StaleSeriesThreshold"sv;		//!< Snap plugin configuration key
+			static constexpr std::string_view configKeyMaxSeries = "MaxSeries"sv;		//!< Snap plugin configuration key
+			static constexpr std::string_view configKeyDispatchQueueSize = "DispatchQueueSize"sv;			//!< Snap plugin configuration key
+			static constexpr std::string_view configKeyDispatchOverflowPolicy = "DispatchOverflowPolicy"sv;	//!< Snap plugin configuration key
+			static constexpr std::string_view configKeyConfigCacheFile = "ConfigCacheFile"sv;				//!< Snap plugin configuration key
+			static constexpr std::string_view configKeyCounterCheckpointFile = "CounterCheckpointFile"sv;	//!< Snap plugin configuration key
+			static constexpr std::array configKeysInt = {configKeySamplingInterval, configKeySamplingIntervalMs, configKeyMaxCollectDuration, configKeyMaxMetricsBuffer, configKeyMaxMetricsBufferDelayMs, configKeyStaleSeriesThreshold, configKeyMaxSeries, configKeyDispatchQueueSize};		//!< Array of integer-valued configuration keys
+			static constexpr std::array configKeysBool = {configKeySendAllMetrics, configKeySelfMetrics};	//!< Array of boolean-valued configuration keys
 			static constexpr bool defaultSendAllMetrics = false;											//!< Snap plugin configuration default value
+			static constexpr bool defaultSelfMetrics = false;												//!< Snap plugin configuration default value
 			static constexpr std::chrono::seconds defaultMaxCollectDuration = 0s;							//!< Snap plugin configuration default value
 			static constexpr size_t defaultMaxMetricsBuffer = 0;											//!< Snap plugin configuration default value
-			static constexpr std::array<int, configKeysInt.size()> configValuesInt = {AnyCollect::Controller::defaultSamplingInterval.count(), SnapInterface::defaultMaxCollectDuration.count(), SnapInterface::defaultMaxMetricsBuffer};		//!< Array of integer-valued configuration default values
-			static constexpr std::array<int, configKeysBool.size()> configValuesBool = {SnapInterface::defaultSendAllMetrics};		//!< Array of boolean-valued configuration default values
-			static std::hash<std::string> hasher;															//!< Object used to compute keys (string hashes)
-
-			AnyCollect::Controller controller_;																//!< Controller used to collect statistics
-			std::map<size_t, Plugin::Metric> metrics_;														//!< Map associating keys to their metric
-			std::set<size_t> requestedMetrics_;																//!< Array of keys of requested metrics
-			std::set<size_t> unwantedMetrics_;																//!< Array of keys of non requested metrics
+			static constexpr std::chrono::milliseconds defaultMaxMetricsBufferDelay = 0ms;					//!< Snap plugin configuration default value (0 for one sampling interval)
+			static constexpr size_t maxFormattedNamePartCount = 1 << 16;									//!< Number of formatted name parts above which the cache is emptied
+			static constexpr size_t defaultDispatchQueueSize = 0;											//!< Snap plugin configuration default value
+			static constexpr std::string_view defaultDispatchOverflowPolicy = AnyCollect::Dispatcher::overflowBlockString;		//!< Snap plugin configuration default value
+			static constexpr std::array<int, configKeysInt.size()> configValuesInt = {static_cast<int>(std::chrono::duration_cast<std::chrono::seconds>(AnyCollect::Controller::defaultSamplingInterval).count()), 0, SnapInterface::defaultMaxCollectDuration.count(), SnapInterface::defaultMaxMetricsBuffer, static_cast<int>(SnapInterface::defaultMaxMetricsBufferDelay.count()), AnyCollect::Controller::defaultStaleSeriesThreshold, AnyCollect::Controller::defaultMaxSeries, SnapInterface::defaultDispatchQueueSize};		//!< Array of integer-valued configuration default values
+			static constexpr std::array<int, configKeysBool.size()> configValuesBool = {SnapInterface::defaultSendAllMetrics, SnapInterface::defaultSelfMetrics};		//!< Array of boolean-valued configuration default values
+
+			AnyCollect::Controller controller_;																//!< Controller used to list available metrics
+			std::string configPath_;																		//!< Path of AnyCollect's config file
+			std::optional<Key> configHash_;																	//!< Hash of the config file contents when it was loaded, if it could be read
+			std::optional<std::vector<Metric>> availableMetrics_;											//!< Metrics available with the loaded config, once discovered
+			std::chrono::milliseconds samplingInterval_;													//!< Interval between two sendings of metrics
+			std::function<void(Controller&)> configureController_;											//!< Function applying the collection settings of the plugin configuration to the shared controller, once streaming
+			std::unordered_map<Key, Plugin::Metric> metrics_;												//!< Map associating keys of sent series to their Snap metric, only updated with the latest value before sending
+			std::unordered_set<Key> requestedMetrics_;														//!< Set of name keys of requested metrics
+			std::vector<std::vector<std::string>> requestedNames_;											//!< Array of requested metric names (without the plugin name prefix)
+			std::unordered_set<Key> unwantedMetrics_;														//!< Set of keys of non requested series
+			std::unordered_map<std::string, std::string> formattedNameParts_;								//!< Map associating metric name parts to their formatted version, since series share most of them
 			bool sendAllMetrics_;																			//!< Whether to send all metrics, regardless of which are requested
 			std::vector<Plugin::Metric*> metricsToSend_;													//!< Array of pointers to Snap metrics to be sent
+			size_t maxMetricsBuffer_;																		//!< Maximum number of metrics sent to Snap at once (0 to send each collection round at once)
+			std::vector<Plugin::Metric> bufferedMetrics_;													//!< Array of metrics waiting to be sent to Snap
+			std::chrono::milliseconds maxMetricsBufferDelay_;												//!< Maximum time metrics are kept in the buffer before being sent to Snap
+			std::chrono::steady_clock::time_point bufferStartTime_;										//!< Time at which the oldest metric of `bufferedMetrics_` was buffered
 
 
 			/**
@@ -77,7 +106,26 @@ namespace AnyCollect {
 			void setConfig(const Plugin::Config& cfg);
 
 			/**
-			 * @brief Formats a metric name to be compatible with Snap requirements
+			 * @brief Returns the hash of a config file's contents, or nothing if it cannot be read
+			 *
+			 * @param configPath path of the config file
+			 */
+			static std::optional<Key> hashConfigFile(const std::string& configPath);
+
+			/**
+			 * @brief Returns the metrics available with the loaded config, running a collection iteration only the first time
+			 */
+			const std::vector<Metric>& availableMetrics();
+
+			/**
+			 * @brief Formats a metric name part to be compatible with Snap requirements
+			 *
+			 * @param part name part to format
+			 */
+			static void formatNamePart(std::string& part);
+
+			/**
+			 * @brief Formats a metric name to be compatible with Snap requirements, caching formatted parts
 			 *
 			 * @param name name to format
 			 */
@@ -86,10 +134,12 @@ namespace AnyCollect {
 			/**
 			 * @brief Computes a key based solely on a metric's name
 			 *
-			 * @param m the metric to compute the name key
+			 * The key is computed the same way as `Metric::generateKey`, on the formatted name parts.
+			 *
+			 * @param name the formatted name of the metric
 			 * @return the computed name key
 			 */
-			size_t computeNameKey(const Metric& m);
+			Key computeNameKey(const std::vector<std::string>& name);
 
 			/**
 			 * @brief Computes a key based solely on a metric's name
@@ -97,15 +147,41 @@ namespace AnyCollect {
 			 * @param m the Snap metric to compute the name key
 			 * @return the computed name key
 			 */
-			size_t computeNameKey(const Plugin::Metric& m);
+			Key computeNameKey(const Plugin::Metric& m);
 
 			/**
 			 * @brief Converts a metric object into a Snap metric object
 			 *
 			 * @param metric the metric to convert
+			 * @param name the formatted name of the metric
 			 * @return the converted metric
 			 */
-			Plugin::Metric convertToSnapMetric(const Metric& metric);
+			Plugin::Metric convertToSnapMetric(const Metric& metric, std::vector<std::string> name);
+
+			/**
+			 * @brief Returns the Snap metric of a series, converting it the first time the series is seen
+			 *
+			 * @param metric a metric of the series
+			 * @return the Snap metric of the series, or null if the series is not requested
+			 */
+			Plugin::Metric* findSnapMetric(const Metric& metric);
+
+			/**
+			 * @brief Returns whether a matcher may produce a requested metric
+			 *
+			 * Name parts with substitutions may become anything, so only the other parts are compared, once formatted. This runs on the collecting thread (as the controller's matcher filter), so it does not use the formatted name parts cache.
+			 *
+			 * @param matcher the matcher to check
+			 * @param requestedNames the requested metric names (without the plugin name prefix)
+			 */
+			static bool canProduceRequestedMetric(const Matcher& matcher, const std::vector<std::vector<std::string>>& requestedNames);
+
+			/**
+			 * @brief Sends buffered metrics to Snap, in batches of at most `maxMetricsBuffer_` metrics
+			 *
+			 * @param sendAll whether to send all buffered metrics, or only full batches unless waiting for the next round would exceed `maxMetricsBufferDelay_`
+			 */
+			void sendBufferedMetrics(bool sendAll);
 
 		public:
 			/**
@@ -144,6 +220,7 @@ namespace AnyCollect {
 
 			void contollerCollectedMetrics(const Controller& controller, const std::vector<const Metric*>& metrics) override final;
 			bool contollerShouldStopCollectingMetrics(const Controller& controller) override final;
+			void contollerEvictedMetrics(const Controller& controller, const std::vector<Key>& keys) override final;
 
 	};
 }
@@ -18,6 +18,8 @@
 // limitations under the License.
 //
 
+#include <cmath>
+#include <csignal>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -36,9 +38,10 @@ std::ostream &operator<<(std::ostream &stream,
 
 
 void printMetric(const AnyCollect::Metric& m) {
-	std::string name = m.name()[0];
-	for (size_t i = 1; i < m.name().size(); i++)
-		name += "/" + m.name()[i];
+	auto nameParts = m.name();
+	std::string name = nameParts[0];
+	for (size_t i = 1; i < nameParts.size(); i++)
+		name += "/" + nameParts[i];
 	std::string tags;
 	for (const auto& [k, v] : m.tags())
 		tags += "'" + k + "'='" + v + "', ";
@@ -50,8 +53,17 @@ void printMetric(const AnyCollect::Metric& m) {
 }
 
 
+volatile std::sig_atomic_t isReloadRequested = 0;
+
+void requestReload(int ) {
+	isReloadRequested = 1;
+}
+
+
 struct AnyCollectValues : public AnyCollect::ControllerDelegate {
 	size_t iterationCount;
+	AnyCollect::Controller* controller = nullptr;
+	std::string configPath;
 
 #if PRINT_METRICS
 	void contollerCollectedMetrics(const AnyCollect::Controller& , const std::vector<const AnyCollect::Metric*>& metrics) override {
@@ -64,6 +76,10 @@ struct AnyCollectValues : public AnyCollect::ControllerDelegate {
 	}
 
 	bool contollerShouldStopCollectingMetrics(const AnyCollect::Controller& ) override {
+		if (isReloadRequested) {
+			isReloadRequested = 0;
+			controller->loadConfigFromFile(configPath);
+		}
 		iterationCount--;
 		return iterationCount == 0;
 	}
@@ -76,7 +92,7 @@ int main(int argc, char* argv[]) {
 	AnyCollectValues d;
 
 	if (argc > 1)
-		samplingInterval = std::chrono::seconds(std::atol(argv[1]));
+		samplingInterval = std::chrono::milliseconds(std::llround(std::atof(argv[1]) * 1000));
 	if (argc > 2)
 		configPath = argv[2];
 	if (argc > 3)
@@ -87,6 +103,9 @@ int main(int argc, char* argv[]) {
 	AnyCollect::Controller controller(d);
 	controller.setSamplingInterval(samplingInterval);
 	controller.loadConfigFromFile(configPath);
+	d.controller = &controller;
+	d.configPath = configPath;
+	std::signal(SIGHUP, requestReload);
 
 	controller.collectMetrics();
 